@@ -10,6 +10,8 @@ struct sleeplock;
 struct stat;
 struct superblock;
 struct pstat;
+struct pstat2;
+struct procinfo;
 
 // bio.c
 void            binit(void);
@@ -79,6 +81,7 @@ int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(uchar, int);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
@@ -120,11 +123,22 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
+int             wakeupsync(void*);
+void            piboost(struct proc*, struct proc*);
+void            piunboost(struct proc*);
 void            yield(void);
 int 			setslice(int, int);
 int 			getslice(int);
 int 			fork2(int);
 int 			getpinfo(struct pstat*);
+int 			settickets(int, int);
+int 			setsched(int);
+int 			getpinfo2(struct pstat2*);
+int 			setaffinity(int, int);
+int 			getaffinity(int);
+int 			getprocs(int*, struct procinfo*, int);
+int 			setdeadline(int, int, int);
+int 			yieldto(int);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -0,0 +1,92 @@
+#include "types.h"
+#include "user.h"
+#include "pstat.h"
+
+// Runs a set of periodic real-time tasks under EDF next to
+// CPU-bound normal processes and reports how many deadlines
+// each task missed. Every task wants the CPU all the time, so
+// it is held to its runtime per period by its EDF budget.
+//
+//   edftest [ticks] [nspin]
+
+#define NTASK 3
+#define NINFO 8
+
+static int runtime[NTASK] = {1, 2, 3};
+static int period[NTASK] = {5, 10, 20};
+
+static struct procinfo info[NINFO];
+
+static int workload(int iters) {
+    int i = 0, j = 0;
+    while (i < iters) {
+        j += i * j + 1;
+        i++;
+    }
+    return j;
+}
+
+static int spawn(void) {
+    int pid = fork();
+    if (pid == 0) {
+        for (;;) {
+            int w = workload(1000000);
+            kill(-w);  // keep the workload from being optimized out
+        }
+    }
+    return pid;
+}
+
+int main(int argc, char **argv) {
+    int ticks = 500, nspin = 2;
+    int tasks[NTASK], spinners[8];
+    int cursor = 0, n, extra;
+
+    if (argc > 1)
+        ticks = atoi(argv[1]);
+    if (argc > 2)
+        nspin = atoi(argv[2]);
+    if (nspin > 8)
+        nspin = 8;
+
+    for (int i = 0; i < nspin; i++)
+        spinners[i] = spawn();
+    for (int t = 0; t < NTASK; t++) {
+        tasks[t] = spawn();
+        if (setdeadline(tasks[t], runtime[t], period[t]) != 0)
+            printf(1, "EDF admit runtime=%d period=%d rejected\n", runtime[t], period[t]);
+    }
+
+    // admission control, this one would take the total past the limit
+    extra = spawn();
+    printf(1, "EDF admit runtime=9 period=10 %s\n",
+           setdeadline(extra, 9, 10) == 0 ? "accepted" : "rejected");
+    kill(extra);
+    wait();
+
+    sleep(ticks);
+
+    while ((n = getprocs(&cursor, info, NINFO)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (info[i].ppid != getpid())
+                continue;
+            if (info[i].period > 0) {
+                printf(1, "EDF pid=%d runtime=%d period=%d periods=%d misses=%d missrate=%d%% ticks=%d\n",
+                       info[i].pid, info[i].runtime, info[i].period, info[i].periods,
+                       info[i].misses,
+                       info[i].periods ? info[i].misses * 100 / info[i].periods : 0,
+                       info[i].schedticks);
+            } else {
+                printf(1, "NORMAL pid=%d ticks=%d\n", info[i].pid, info[i].schedticks);
+            }
+        }
+    }
+
+    for (int t = 0; t < NTASK; t++)
+        kill(tasks[t]);
+    for (int i = 0; i < nspin; i++)
+        kill(spinners[i]);
+    while (wait() >= 0)
+        ;
+    exit();
+}
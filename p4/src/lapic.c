@@ -160,6 +160,19 @@ lapicstartap(uchar apicid, uint addr)
   }
 }
 
+// Send a fixed interrupt with the given vector to one CPU.
+void
+lapicipi(uchar apicid, int vector)
+{
+  if(!lapic)
+    return;
+
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
 #define CMOS_STATA   0x0a
 #define CMOS_STATB   0x0b
 #define CMOS_UIP    (1 << 7)        // RTC update in progress
@@ -0,0 +1,57 @@
+#include "types.h"
+#include "user.h"
+#include "pstat.h"
+
+// Prints run queue wait histograms. Each process or CPU gets a
+// line "<who> <id> dispatches <n>", where who is "pid" or "cpu",
+// then one line per non-empty bucket b as "<who> <id> 2^<b>
+// <count>", counting waits of [2^b, 2^(b+1)) TSC cycles (the last
+// bucket also holds anything longer). Processes come from
+// getprocs(), CPUs from getpinfo2().
+
+#define NINFO 8
+
+static struct pstat2 ps;
+static struct procinfo info[NINFO];
+
+static void printhist(char *who, int id, uint dispatches, uint *hist) {
+    printf(1, "%s %d dispatches %d\n", who, id, dispatches);
+    for (int b = 0; b < NLATBUCKET; b++) {
+        if (hist[b] != 0) {
+            printf(1, "%s %d 2^%d %d\n", who, id, b, hist[b]);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    int pid = 0;
+    int cursor = 0;
+    int n;
+
+    if (argc > 2) {
+        printf(2, "usage: latstat [pid]\n");
+        exit();
+    }
+    if (argc == 2) {
+        pid = atoi(argv[1]);
+    }
+
+    if (getpinfo2(&ps) != 0) {
+        printf(2, "getpinfo2 failed\n");
+        exit();
+    }
+
+    while ((n = getprocs(&cursor, info, NINFO)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (pid == 0 || info[i].pid == pid) {
+                printhist("pid", info[i].pid, info[i].dispatches, info[i].waithist);
+            }
+        }
+    }
+    if (pid == 0) {
+        for (int c = 0; c < ps.ps.ncpu; c++) {
+            printhist("cpu", c, ps.cpudispatches[c], ps.cpuwaithist[c]);
+        }
+    }
+    exit();
+}
@@ -4,86 +4,1067 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
 #include "pstat.h"
+#include "traps.h"
+#include "sched.h"
 
+#define PROCPERPAGE (PGSIZE / sizeof(struct proc))
+#define NPROCPAGE ((MAXPROC + PROCPERPAGE - 1) / PROCPERPAGE)
+
+/*
+ * The process table grows a page of slots at a time, up
+ * to MAXPROC. Pages are never given back, so a struct proc
+ * stays valid after its process is reaped. lock covers
+ * growing the table and the free list; nslot only grows
+ * and may be read without it.
+ */
 struct
 {
 	struct spinlock lock;
-	struct proc proc[NPROC];
+	struct proc *page[NPROCPAGE];
+	int npage;
+	volatile int nslot;
+	struct proc *free; // UNUSED slots, linked through next
 } ptable;
 
 static struct proc *initproc;
 
-struct proc *head = 0;
-struct proc *tail = 0;
+/*
+ * The process in slot i, or 0 past the end of the table
+ */
+static struct proc *procslot(int i)
+{
+	if (i < 0 || i >= ptable.nslot)
+		return 0;
+	return &ptable.page[i / PROCPERPAGE][i % PROCPERPAGE];
+}
+
+/*
+ * Locking. Each process's lock covers its state, chan,
+ * killed and pid. wait_lock covers every p->parent and
+ * child list, so wait() and exit() don't race on a child. rqlock covers
+ * the run queues, the policy and its per-process fields
+ * (pass, level, tickets, affinity) and the CPU idle flags.
+ *
+ * Locks are taken in this order: the lock passed to
+ * sleep() or wait_lock, then a wait queue or timerlock,
+ * then p->lock, then rqlock. pid_lock, ptable.lock and
+ * pubstat.rowlock are taken last, pubstat.readlock before
+ * pubstat.rowlock. A process's lock is held across swtch
+ * in both directions.
+ */
+static struct spinlock wait_lock;
+static struct spinlock rqlock;
+static struct spinlock timerlock; // covers the timers heap
+static struct spinlock pid_lock; // covers nextpid and pidhash
+
+#define NPIDHASH 67 // pid hash buckets, prime
+
+// live processes hashed by pid, chained through hnext
+static struct proc *pidhash[NPIDHASH];
+
+/*
+ * Intrusive doubly linked run queue. Only RUNNABLE processes
+ * that are not currently on a CPU are linked in, so the head is
+ * always the next process to dispatch.
+ */
+struct runqueue
+{
+	struct proc *head;
+	struct proc *tail;
+	int len;
+};
+
+static struct runqueue runq;
 
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
-static void wakeup1(void *chan);
+#define NSLEEPQ 61 // number of wait queue buckets, prime
+
+/*
+ * Sleeping processes, hashed by chan so that wakeup
+ * only visits processes that might be sleeping on it.
+ * Each bucket has its own lock.
+ */
+static struct sleepq
+{
+	struct spinlock lock;
+	struct proc *head;
+	struct proc *tail;
+} sleepq[NSLEEPQ];
 
-void printlist(struct proc *head)
+static struct sleepq *
+chanq(void *chan)
 {
-	cprintf("[pid: %d]\n", head->pid);
-	struct proc *cur = head->next;
-	while (cur != 0)
+	return &sleepq[((uint)chan >> 2) % NSLEEPQ];
+}
+
+/*
+ * The lock of the queue a sleeper on chan waits in
+ */
+static struct spinlock *
+chanlock(void *chan)
+{
+	if (chan == &ticks)
+		return &timerlock;
+	return &chanq(chan)->lock;
+}
+
+/*
+ * Append p to the wait queue for p->chan
+ */
+static void sleepqadd(struct proc *p)
+{
+	struct sleepq *q = chanq(p->chan);
+
+	p->wnext = 0;
+	p->wprev = q->tail;
+	if (q->tail)
+		q->tail->wnext = p;
+	else
+		q->head = p;
+	q->tail = p;
+}
+
+/*
+ * Unlink p from the wait queue for p->chan
+ */
+static void sleepqremove(struct proc *p)
+{
+	struct sleepq *q = chanq(p->chan);
+
+	if (p->wprev)
+		p->wprev->wnext = p->wnext;
+	else
+		q->head = p->wnext;
+	if (p->wnext)
+		p->wnext->wprev = p->wprev;
+	else
+		q->tail = p->wprev;
+	p->wnext = 0;
+	p->wprev = 0;
+}
+
+void printlist(struct runqueue *q)
+{
+	struct proc *cur;
+
+	for (cur = q->head; cur != 0; cur = cur->next)
 	{
 		cprintf("[pid: %d]\n", cur->pid);
-		cur = cur->next;
 	}
 }
 
 /*
- * Push to the queue
+ * Push to the tail of the queue
  */
-void push(struct proc *p)
+void push(struct runqueue *q, struct proc *p)
 {
-	if (p == 0) {
-		cprintf("addToTail: p is null, cannot add to tail.\n");
+	if (p == 0)
+	{
+		cprintf("push: p is null, cannot add to tail.\n");
 		return;
 	}
+	if (p->inqueue)
+		panic("push: already queued");
+
+	p->next = 0;
+	p->prev = q->tail;
+	if (q->tail == 0)
+		q->head = p;
+	else
+		q->tail->next = p;
+	q->tail = p;
+	p->inqueue = 1;
+	q->len++;
+}
 
-	// queue is empty
-	if (head == 0)
+/*
+ * Push to the head of the queue, used to keep
+ * a process in front while it has slice left
+ */
+void pushfront(struct runqueue *q, struct proc *p)
+{
+	if (p->inqueue)
+		panic("pushfront: already queued");
+
+	p->prev = 0;
+	p->next = q->head;
+	if (q->head == 0)
+		q->tail = p;
+	else
+		q->head->prev = p;
+	q->head = p;
+	p->inqueue = 1;
+	q->len++;
+}
+
+/*
+ * Unlink a process from anywhere in the queue
+ */
+void qremove(struct runqueue *q, struct proc *p)
+{
+	if (!p->inqueue)
+		return;
+
+	if (p->prev == 0)
+		q->head = p->next;
+	else
+		p->prev->next = p->next;
+	if (p->next == 0)
+		q->tail = p->prev;
+	else
+		p->next->prev = p->prev;
+	p->next = 0;
+	p->prev = 0;
+	p->inqueue = 0;
+	q->len--;
+}
+
+/*
+ * Delete from the head of the queue
+ */
+struct proc *pop(struct runqueue *q)
+{
+	struct proc *p = q->head;
+
+	if (p != 0)
+		qremove(q, p);
+	return p;
+}
+
+/*
+ * Whether CPU affinity lets p run on c, any CPU if c is 0
+ */
+static int canrun(struct proc *p, struct cpu *c)
+{
+	return c == 0 || (p->affinity & (1 << (c - cpus)));
+}
+
+/*
+ * Delete the first process allowed to run on c
+ */
+static struct proc *popfor(struct runqueue *q, struct cpu *c)
+{
+	struct proc *p;
+
+	for (p = q->head; p != 0; p = p->next)
 	{
-		head = p;
-		tail = p;
-		p->next = 0;
+		if (canrun(p, c))
+		{
+			qremove(q, p);
+			return p;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Binary min-heap of processes ordered by before(). A process
+ * is in at most one heap at a time (timed sleepers are never
+ * runnable), so all heaps share p->heapindex.
+ * timers is protected by timerlock, strideq by rqlock.
+ */
+struct procheap
+{
+	struct proc *heap[MAXPROC];
+	int n;
+	int (*before)(struct proc *, struct proc *);
+};
+
+static void heapswap(struct procheap *h, int i, int j)
+{
+	struct proc *t = h->heap[i];
+
+	h->heap[i] = h->heap[j];
+	h->heap[j] = t;
+	h->heap[i]->heapindex = i;
+	h->heap[j]->heapindex = j;
+}
+
+static void heapup(struct procheap *h, int i)
+{
+	while (i > 0 && h->before(h->heap[i], h->heap[(i - 1) / 2]))
+	{
+		heapswap(h, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void heapdown(struct procheap *h, int i)
+{
+	int l, m;
+
+	for (;;)
+	{
+		m = i;
+		l = 2 * i + 1;
+		if (l < h->n && h->before(h->heap[l], h->heap[m]))
+			m = l;
+		if (l + 1 < h->n && h->before(h->heap[l + 1], h->heap[m]))
+			m = l + 1;
+		if (m == i)
+			return;
+		heapswap(h, i, m);
+		i = m;
+	}
+}
+
+/*
+ * Add a process to a heap
+ */
+static void heapinsert(struct procheap *h, struct proc *p)
+{
+	p->heapindex = h->n;
+	h->heap[h->n++] = p;
+	heapup(h, p->heapindex);
+}
+
+/*
+ * Remove a process from anywhere in a heap, no-op if
+ * it is not in this one
+ */
+static void heapremove(struct procheap *h, struct proc *p)
+{
+	int i = p->heapindex;
+
+	if (i < 0 || i >= h->n || h->heap[i] != p)
 		return;
+
+	h->n--;
+	if (i != h->n)
+	{
+		h->heap[i] = h->heap[h->n];
+		h->heap[i]->heapindex = i;
+		heapdown(h, i);
+		heapup(h, i);
+	}
+	p->heapindex = -1;
+}
+
+/*
+ * Remove and return the first process of a heap
+ */
+static struct proc *heappop(struct procheap *h)
+{
+	struct proc *p;
+
+	if (h->n == 0)
+		return 0;
+	p = h->heap[0];
+	heapremove(h, p);
+	return p;
+}
+
+/*
+ * Remove and return the first process of a heap that
+ * is allowed to run on c
+ */
+static struct proc *heappopfor(struct procheap *h, struct cpu *c)
+{
+	struct proc *skipped = 0; // linked through next, unused in a heap
+	struct proc *p;
+
+	while ((p = heappop(h)) != 0 && !canrun(p, c))
+	{
+		p->next = skipped;
+		skipped = p;
+	}
+	while (skipped != 0)
+	{
+		heapinsert(h, skipped);
+		skipped = skipped->next;
+	}
+	return p;
+}
+
+static int deadlinebefore(struct proc *a, struct proc *b)
+{
+	return a->sleepdeadline < b->sleepdeadline;
+}
+
+static int passbefore(struct proc *a, struct proc *b)
+{
+	return (int)(a->pass - b->pass) < 0; // safe across wraparound
+}
+
+// processes in a timed sleep, so a tick only touches the ones due
+static struct procheap timers = {.before = deadlinebefore};
+
+// RUNNABLE processes under SCHED_STRIDE, lowest pass first
+static struct procheap strideq = {.before = passbefore};
+
+// RUNNABLE processes under SCHED_MLFQ, one queue per level
+static struct runqueue mlfq[NMLFQ];
+
+static int edfbefore(struct proc *a, struct proc *b)
+{
+	return (int)(a->edfdeadline - b->edfdeadline) < 0;
+}
+
+// RUNNABLE EDF processes with budget left, earliest deadline
+// first. They run ahead of every other process.
+static struct procheap edfq = {.before = edfbefore};
+
+// RUNNABLE EDF processes that used up their budget and wait
+// for their next period
+static struct runqueue edfthrottled;
+
+static struct proc *edfprocs; // admitted to EDF, linked by edfnext
+static int edfutil;           // sum of their edfutil
+
+// ticks a process may use at each MLFQ level before demotion
+static int mlfqslice[NMLFQ] = {1, 2, 4, 8};
+
+int schedpolicy = SCHEDPOLICY;
+static uint globalpass; // pass of the last stride dispatch
+
+/*
+ * Ticks spent in the current timed sleep, computed from
+ * the start timestamp instead of counted on every tick
+ */
+static int pendingsleepticks(struct proc *p)
+{
+	if (p->state != SLEEPING || p->chan != &ticks)
+		return 0;
+	return ticks - p->sleepstart;
+}
+
+/*
+ * Scheduling statistics published for getpinfo, double
+ * buffered. Publishers write a process's row into both
+ * buffers, except one getpinfo has frozen to copy out:
+ * there they only mark the row dirty, and getpinfo brings
+ * the dirty rows up to date when it lets the buffer go.
+ * A frozen buffer holds every row as of the moment it was
+ * frozen, and getpinfo never waits on the scheduler or
+ * retries. rowlock[i] serializes the publishers of row i
+ * (a process's p->lock and rqlock both may cover it), so
+ * the scheduler takes no global lock to publish.
+ */
+struct pubbuf
+{
+	struct pstat ps;
+	int timedsleep[NPROC]; // add ticks since sleepstart to sleepticks
+	uint sleepstart[NPROC];
+};
+
+static struct
+{
+	struct spinlock rowlock[NPROC];
+	struct spinlock readlock; // serializes getpinfo
+	volatile int frozen; // buffer being copied out, or -1
+	char dirty[NPROC]; // row published while frozen
+	struct pubbuf buf[2];
+} pubstat;
+
+/*
+ * Fill row i of b from p
+ */
+static void putrow(struct pubbuf *b, int i, struct proc *p)
+{
+	b->ps.inuse[i] = p->state != UNUSED;
+	b->ps.pid[i] = p->pid;
+	b->ps.timeslice[i] = p->timeslice;
+	b->ps.compticks[i] = p->compticks;
+	b->ps.schedticks[i] = p->schedticks;
+	b->ps.sleepticks[i] = p->sleepticks;
+	b->ps.switches[i] = p->switches;
+	b->ps.tickets[i] = p->tickets;
+	b->ps.pass[i] = p->pass;
+	b->ps.level[i] = p->level;
+	b->ps.lastcpu[i] = p->lastcpu;
+	b->ps.misses[i] = p->edfmisses;
+	b->ps.periods[i] = p->edfperiods;
+	b->timedsleep[i] = p->state == SLEEPING && p->chan == &ticks;
+	b->sleepstart[i] = p->sleepstart;
+}
+
+/*
+ * Copy row i of buffer from into buffer to
+ */
+static void copyrow(struct pubbuf *to, struct pubbuf *from, int i)
+{
+	to->ps.inuse[i] = from->ps.inuse[i];
+	to->ps.pid[i] = from->ps.pid[i];
+	to->ps.timeslice[i] = from->ps.timeslice[i];
+	to->ps.compticks[i] = from->ps.compticks[i];
+	to->ps.schedticks[i] = from->ps.schedticks[i];
+	to->ps.sleepticks[i] = from->ps.sleepticks[i];
+	to->ps.switches[i] = from->ps.switches[i];
+	to->ps.tickets[i] = from->ps.tickets[i];
+	to->ps.pass[i] = from->ps.pass[i];
+	to->ps.level[i] = from->ps.level[i];
+	to->ps.lastcpu[i] = from->ps.lastcpu[i];
+	to->ps.misses[i] = from->ps.misses[i];
+	to->ps.periods[i] = from->ps.periods[i];
+	to->timedsleep[i] = from->timedsleep[i];
+	to->sleepstart[i] = from->sleepstart[i];
+}
+
+/*
+ * Publish the statistics of p. Caller must hold p->lock
+ * or rqlock so its fields are stable.
+ */
+static void publish(struct proc *p)
+{
+	int i = p->slot;
+	int b;
+
+	if (i >= NPROC)
+		return; // only the first NPROC slots fit in a pstat
+
+	acquire(&pubstat.rowlock[i]);
+	for (b = 0; b < 2; b++)
+	{
+		if (b == pubstat.frozen)
+			pubstat.dirty[i] = 1;
+		else
+			putrow(&pubstat.buf[b], i, p);
+	}
+	release(&pubstat.rowlock[i]);
+}
+
+/*
+ * Wait out publishers that may have looked at
+ * pubstat.frozen before it last changed
+ */
+static void pubdrain(void)
+{
+	int i;
+
+	for (i = 0; i < NPROC; i++)
+	{
+		acquire(&pubstat.rowlock[i]);
+		release(&pubstat.rowlock[i]);
 	}
-	tail->next = p;
-	p->next = 0;
-	tail = p;
 }
 
 /*
- * Delete from the queue
+ * Wake one halted CPU other than this one that may run
+ * p with an IPI. Caller must hold rqlock.
  */
-void pop()
+static void kickidle(struct proc *p)
 {
-	if (head == 0)
+	struct cpu *c;
+	struct cpu *me = mycpu();
+
+	for (c = cpus; c < cpus + ncpu; c++)
 	{
-		cprintf("deleteFromList: list is empty.\n");
+		if (c != me && c->idle && canrun(p, c))
+		{
+			c->idle = 0; // claimed, so the next wakeup picks another CPU
+			lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
+			return;
+		}
+	}
+}
+
+/*
+ * Queue a RUNNABLE process under the current policy, or
+ * in the EDF queues if it is real-time. front keeps a
+ * round-robin process ahead of the others.
+ */
+static void enqueue(struct proc *p, int front)
+{
+	struct runqueue *q = &runq;
+
+	p->enqueuetsc = rdtsc();
+
+	if (p->edfperiod > 0)
+	{
+		if (p->edfbudget > 0)
+			heapinsert(&edfq, p);
+		else
+			push(&edfthrottled, p);
 		return;
 	}
+	if (schedpolicy == SCHED_STRIDE)
+	{
+		heapinsert(&strideq, p);
+		return;
+	}
+	if (schedpolicy == SCHED_MLFQ)
+		q = &mlfq[p->level];
+	if (front)
+		pushfront(q, p);
+	else
+		push(q, p);
+}
 
-	// queue holds one process
-	if (head->pid == tail->pid)
+/*
+ * Take the next process to run on c under the current
+ * policy, skipping processes pinned elsewhere. A null c
+ * takes any process. EDF processes are not included.
+ */
+static struct proc *dequeuepolicy(struct cpu *c)
+{
+	struct proc *p;
+	int i;
+
+	if (schedpolicy == SCHED_STRIDE)
+		return heappopfor(&strideq, c);
+	if (schedpolicy == SCHED_MLFQ)
+	{
+		for (i = 0; i < NMLFQ; i++)
+			if ((p = popfor(&mlfq[i], c)) != 0)
+				return p;
+		return 0;
+	}
+	return popfor(&runq, c);
+}
+
+/*
+ * Take the next process to run on c, real-time first
+ */
+static struct proc *dequeue(struct cpu *c)
+{
+	struct proc *p;
+
+	if ((p = heappopfor(&edfq, c)) != 0)
+		return p;
+	return dequeuepolicy(c);
+}
+
+/*
+ * Whether a RUNNABLE process is sitting in a run queue,
+ * rather than on its way to a CPU
+ */
+static int queued(struct proc *p)
+{
+	return p->inqueue || p->heapindex >= 0;
+}
+
+/*
+ * Remove a queued process from whichever run queue holds it
+ */
+static void unqueue(struct proc *p)
+{
+	if (p->edfperiod > 0)
+	{
+		heapremove(&edfq, p);
+		qremove(&edfthrottled, p);
+	}
+	else if (schedpolicy == SCHED_STRIDE)
+		heapremove(&strideq, p);
+	else if (schedpolicy == SCHED_MLFQ)
+		qremove(&mlfq[p->level], p);
+	else
+		qremove(&runq, p);
+}
+
+/*
+ * Record how long a process waited on the run queue,
+ * in the process's and this CPU's histograms
+ */
+static void recordwait(struct cpu *c, struct proc *p)
+{
+	uint64 wait = rdtsc() - p->enqueuetsc;
+	int b = 0;
+
+	while (b < NLATBUCKET - 1 && (wait >> (b + 1)) != 0)
+		b++;
+	p->waithist[b]++;
+	p->dispatches++;
+	c->waithist[b]++;
+	c->dispatches++;
+}
+
+/*
+ * Timeslice and tickets of a process, counting what
+ * sleeplock waiters lent it
+ */
+static int effslice(struct proc *p)
+{
+	return p->pislice > p->timeslice ? p->pislice : p->timeslice;
+}
+
+static int efftickets(struct proc *p)
+{
+	return p->pitickets > p->tickets ? p->pitickets : p->tickets;
+}
+
+/*
+ * Account the tick a process is about to be dispatched for
+ */
+static void chargetick(struct proc *p)
+{
+	p->chargedtick = ticks;
+	p->schedticks++;
+
+	if (p->edfperiod > 0)
 	{
-		head = 0;
-		tail = 0;
+		p->edfbudget--;
 		return;
 	}
-	// move to next node in queue
-	head = head->next;
+	if (schedpolicy == SCHED_STRIDE)
+	{
+		// charge the tick up front
+		globalpass = p->pass;
+		p->pass += p->stride;
+		p->switches++;
+	}
+	else if (schedpolicy == SCHED_MLFQ)
+	{
+		p->levelticks++;
+	}
+	else
+	{
+		p->activeticks++; // increment by one because active for one tick
+
+		// process has compensation ticks from sleeping
+		if (p->activeticks > effslice(p))
+		{
+			p->compticks++;
+		}
+	}
+}
+
+/*
+ * Account the tick a running process is handing the rest
+ * of to another, unless it was charged for this tick when
+ * it was dispatched. A process that was itself handed the
+ * CPU has not been. Caller must hold rqlock.
+ */
+static void chargehandoff(struct proc *p)
+{
+	if (p->chargedtick != ticks)
+		chargetick(p);
+}
+
+/*
+ * Put a process that is still RUNNABLE after its
+ * tick back on the run queue
+ */
+static void requeue(struct proc *p)
+{
+	if (p->edfperiod > 0 || schedpolicy == SCHED_STRIDE)
+	{
+		enqueue(p, 0);
+	}
+	else if (schedpolicy == SCHED_MLFQ)
+	{
+		if (p->levelticks < mlfqslice[p->level])
+		{
+			enqueue(p, 1);
+			return;
+		}
+		// used its whole slice at this level, demote
+		p->switches++;
+		p->levelticks = 0;
+		if (p->level < NMLFQ - 1)
+			p->level++;
+		enqueue(p, 0);
+	}
+	else if (p->activeticks < effslice(p) + p->activesleepticks)
+	{
+		// slice left, stay at the front of the queue
+		enqueue(p, 1);
+	}
+	else
+	{
+		// slice used up, go to the back of the queue
+		p->switches++;
+		p->activesleepticks = 0;
+		p->activeticks = 0; // reset ticks
+		enqueue(p, 0);
+	}
+}
+
+/*
+ * Move every process back to the top MLFQ level so
+ * CPU-bound processes cannot be starved forever
+ */
+static void mlfqboost(void)
+{
+	struct proc *p;
+	int i;
+
+	for (i = 1; i < NMLFQ; i++)
+	{
+		while ((p = pop(&mlfq[i])) != 0)
+		{
+			p->level = 0;
+			p->levelticks = 0;
+			push(&mlfq[0], p);
+		}
+	}
+	for (i = 0; (p = procslot(i)) != 0; i++)
+	{
+		p->level = 0;
+		p->levelticks = 0;
+		publish(p);
+	}
+}
+
+/*
+ * Start a new EDF period for every real-time process
+ * whose deadline has come. A period that ends while the
+ * process still wanted the CPU and had budget left is a
+ * miss. Caller must hold rqlock.
+ */
+static void edftick(void)
+{
+	struct proc *p;
+
+	for (p = edfprocs; p != 0; p = p->edfnext)
+	{
+		if ((int)(ticks - p->edfdeadline) < 0)
+			continue;
+		if (p->edfbudget > 0 && (p->state == RUNNABLE || p->state == RUNNING))
+			p->edfmisses++;
+		p->edfperiods++;
+		p->edfbudget = p->edfruntime;
+		p->edfdeadline += p->edfperiod;
+		if ((int)(ticks - p->edfdeadline) >= 0)
+			p->edfdeadline = ticks + p->edfperiod; // fell behind, don't replay
+		if (p->inqueue)
+		{
+			// throttled, runnable again
+			qremove(&edfthrottled, p);
+			heapinsert(&edfq, p);
+			kickidle(p);
+		}
+		else if (p->heapindex >= 0)
+		{
+			// deadline moved, restore heap order
+			heapremove(&edfq, p);
+			heapinsert(&edfq, p);
+		}
+		publish(p);
+	}
+}
+
+/*
+ * Admit p to EDF with the given utilization, or take it
+ * out if runtime is 0. Caller must hold rqlock and p->lock,
+ * with p off the run queues.
+ */
+static void edfset(struct proc *p, int runtime, int period, int util)
+{
+	struct proc **pp;
+
+	if (p->edfperiod > 0)
+	{
+		for (pp = &edfprocs; *pp != 0; pp = &(*pp)->edfnext)
+		{
+			if (*pp == p)
+			{
+				*pp = p->edfnext;
+				break;
+			}
+		}
+		edfutil -= p->edfutil;
+	}
+	// rejoining the normal queue, don't bank stride credit
+	if (runtime == 0 && (int)(p->pass - globalpass) < 0)
+		p->pass = globalpass;
+	p->edfruntime = runtime;
+	p->edfperiod = runtime > 0 ? period : 0;
+	p->edfutil = runtime > 0 ? util : 0;
+	p->edfbudget = runtime;
+	p->edfdeadline = ticks + period;
+	p->edfnext = 0;
+	if (runtime > 0)
+	{
+		p->edfnext = edfprocs;
+		edfprocs = p;
+		edfutil += util;
+	}
+}
+
+/*
+ * Policy bookkeeping for a process coming out of a
+ * sleep. Caller must hold rqlock.
+ */
+static void wakeadjust(struct proc *p)
+{
+	// don't let a sleeper bank credit against the others
+	if ((int)(p->pass - globalpass) < 0)
+		p->pass = globalpass;
+	// blocked for at least a slice, treat as interactive
+	if (schedpolicy == SCHED_MLFQ && p->level > 0 &&
+		ticks - p->sleepstart >= mlfqslice[p->level])
+	{
+		p->level--;
+		p->levelticks = 0;
+	}
+}
+
+/*
+ * Mark a process RUNNABLE and queue it with a fresh
+ * slice. Caller must hold p->lock.
+ */
+static void makerunnable(struct proc *p)
+{
+	p->state = RUNNABLE;
+	p->activeticks = 0;
+
+	acquire(&rqlock);
+	wakeadjust(p);
+	// a process lent priority runs on behalf of its waiters
+	enqueue(p, p->pislice > 0);
+	kickidle(p);
+	release(&rqlock);
+	publish(p);
+}
+
+/*
+ * Like makerunnable, but if this CPU has not been handed a
+ * process already, p runs next here on the rest of the
+ * current tick instead of waiting in the run queue.
+ * Returns 1 if p was handed over, and the caller should
+ * yield once it has let go of its locks. Caller must hold
+ * p->lock.
+ */
+static int handoff(struct proc *p)
+{
+	struct cpu *c;
+
+	acquire(&rqlock);
+	c = mycpu();
+	// real-time processes keep their deadline order
+	if (c->next != 0 || c->proc == 0 || !canrun(p, c) ||
+		p->edfperiod > 0 || edfq.n > 0)
+	{
+		release(&rqlock);
+		makerunnable(p);
+		return 0;
+	}
+	chargehandoff(c->proc);
+	p->state = RUNNABLE;
+	p->activeticks = 0;
+	wakeadjust(p);
+	p->enqueuetsc = rdtsc();
+	c->next = p;
+	release(&rqlock);
+	publish(p);
+	return 1;
 }
 
 void pinit(void)
 {
+	int i;
+
 	initlock(&ptable.lock, "ptable");
+	initlock(&wait_lock, "wait_lock");
+	initlock(&rqlock, "runq");
+	initlock(&timerlock, "timers");
+	initlock(&pid_lock, "nextpid");
+	for (i = 0; i < NPROC; i++)
+		initlock(&pubstat.rowlock[i], "pubrow");
+	initlock(&pubstat.readlock, "pubread");
+	pubstat.frozen = -1;
+	for (i = 0; i < NSLEEPQ; i++)
+		initlock(&sleepq[i].lock, "sleepq");
+}
+
+/*
+ * Give p the next pid and make it findable by it
+ */
+static void allocpid(struct proc *p)
+{
+	struct proc **h;
+
+	acquire(&pid_lock);
+	p->pid = nextpid++;
+	h = &pidhash[p->pid % NPIDHASH];
+	p->hnext = *h;
+	*h = p;
+	release(&pid_lock);
+}
+
+/*
+ * Take p out of the pid hash before its slot is reused
+ */
+static void freepid(struct proc *p)
+{
+	struct proc **h;
+
+	acquire(&pid_lock);
+	for (h = &pidhash[p->pid % NPIDHASH]; *h != 0; h = &(*h)->hnext)
+	{
+		if (*h == p)
+		{
+			*h = p->hnext;
+			break;
+		}
+	}
+	p->hnext = 0;
+	release(&pid_lock);
+}
+
+/*
+ * Find the live process with the given pid and return
+ * it with p->lock held, or 0
+ */
+static struct proc *findproc(int pid)
+{
+	struct proc *p;
+
+	acquire(&pid_lock);
+	for (p = pidhash[(uint)pid % NPIDHASH]; p != 0; p = p->hnext)
+		if (p->pid == pid)
+			break;
+	release(&pid_lock);
+	if (p == 0)
+		return 0;
+
+	// slots are never freed, but this one may have been
+	// reaped or reused since we let go of pid_lock
+	acquire(&p->lock);
+	if (p->pid != pid || p->state == UNUSED)
+	{
+		release(&p->lock);
+		return 0;
+	}
+	return p;
+}
+
+/*
+ * Add a page of UNUSED slots to the table. Caller
+ * must hold ptable.lock.
+ */
+static int growtable(void)
+{
+	struct proc *pg;
+	int i, n;
+
+	if (ptable.npage == NPROCPAGE || (pg = (struct proc *)kalloc()) == 0)
+		return -1;
+	memset(pg, 0, PGSIZE);
+
+	n = PROCPERPAGE;
+	if (ptable.nslot + n > MAXPROC)
+		n = MAXPROC - ptable.nslot;
+	// push in reverse so the lowest slot is used first
+	for (i = n - 1; i >= 0; i--)
+	{
+		initlock(&pg[i].lock, "proc");
+		pg[i].slot = ptable.nslot + i;
+		pg[i].heapindex = -1;
+		pg[i].next = ptable.free;
+		ptable.free = &pg[i];
+	}
+	ptable.page[ptable.npage++] = pg;
+	__sync_synchronize(); // slots are set up before they are visible
+	ptable.nslot += n;
+	return 0;
+}
+
+/*
+ * Put an UNUSED slot back on the free list
+ */
+static void freeslot(struct proc *p)
+{
+	acquire(&ptable.lock);
+	p->next = ptable.free;
+	ptable.free = p;
+	release(&ptable.lock);
 }
 
 // Must be called with interrupts disabled
@@ -139,32 +1120,63 @@ allocproc(void)
 	char *sp;
 
 	acquire(&ptable.lock);
-
-	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-		if (p->state == UNUSED)
-			goto found;
-
+	if (ptable.free == 0 && growtable() < 0)
+	{
+		release(&ptable.lock);
+		return 0;
+	}
+	p = ptable.free;
+	ptable.free = p->next;
 	release(&ptable.lock);
-	return 0;
 
-found:
+	// off the free list, so no one else can claim it
+	acquire(&p->lock);
 	p->state = EMBRYO;
-	p->pid = nextpid++;
+	allocpid(p);
+	p->next = 0;
+	p->child = 0;
+	p->sibling = 0;
 
 	p->compticks = 0;
 	p->schedticks = 0;
 	p->sleepticks = 0;
 	p->switches = 0;
 	p->sleepdeadline = 0;
+	p->heapindex = -1;
+	p->tickets = DEFTICKETS;
+	p->stride = STRIDE1 / DEFTICKETS;
+	p->pass = 0;
+	p->level = 0;
+	p->levelticks = 0;
+	p->dispatches = 0;
+	p->affinity = (1 << NCPU) - 1;
+	p->edfruntime = 0;
+	p->edfperiod = 0;
+	p->edfutil = 0;
+	p->edfbudget = 0;
+	p->edfmisses = 0;
+	p->edfperiods = 0;
+	p->edfnext = 0;
+	p->pislice = 0;
+	p->pitickets = 0;
+	p->nsleeplocks = 0;
+	p->lastcpu = -1;
+	memset(p->waithist, 0, sizeof(p->waithist));
 	p->activeticks = 0;
 	p->activesleepticks = 0;
+	publish(p);
 
-	release(&ptable.lock);
+	release(&p->lock);
 
 	// Allocate kernel stack.
 	if ((p->kstack = kalloc()) == 0)
 	{
+		acquire(&p->lock);
 		p->state = UNUSED;
+		freepid(p);
+		publish(p);
+		release(&p->lock);
+		freeslot(p);
 		return 0;
 	}
 	sp = p->kstack + KSTACKSIZE;
@@ -218,13 +1230,12 @@ void userinit(void)
 	// run this process. the acquire forces the above
 	// writes to be visible, and the lock is also needed
 	// because the assignment might not be atomic.
-	acquire(&ptable.lock);
+	acquire(&p->lock);
 
-	p->state = RUNNABLE;
 	p->timeslice = 1; // initialize time slice
-	push(p); // add to queue
+	makerunnable(p);  // add to queue
 
-	release(&ptable.lock);
+	release(&p->lock);
 }
 
 // Grow current process's memory by n bytes.
@@ -328,23 +1339,42 @@ void exit(void)
 	end_op();
 	curproc->cwd = 0;
 
-	acquire(&ptable.lock);
+	acquire(&wait_lock);
 
 	// Parent might be sleeping in wait().
-	wakeup1(curproc->parent);
+	wakeup(curproc->parent);
 
-	// Pass abandoned children to init.
-	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+	// Pass abandoned children to init. A child only turns
+	// ZOMBIE under wait_lock, so its state can't change here.
+	if ((p = curproc->child) != 0)
 	{
-		if (p->parent == curproc)
+		for (;;)
 		{
 			p->parent = initproc;
 			if (p->state == ZOMBIE)
-				wakeup1(initproc);
+				wakeup(initproc);
+			if (p->sibling == 0)
+				break;
+			p = p->sibling;
 		}
+		p->sibling = initproc->child;
+		initproc->child = curproc->child;
+		curproc->child = 0;
 	}
 
+	// The parent can't reap us until wait_lock is released,
+	// and can't free our stack until the scheduler releases
+	// curproc->lock after switching away from it.
+	acquire(&curproc->lock);
+	if (curproc->edfperiod > 0)
+	{
+		// give back our EDF utilization
+		acquire(&rqlock);
+		edfset(curproc, 0, 0, 0);
+		release(&rqlock);
+	}
 	curproc->state = ZOMBIE;
+	release(&wait_lock);
 	sched();
 	panic("zombie exit");
 }
@@ -353,47 +1383,52 @@ void exit(void)
 // Return -1 if this process has no children.
 int wait(void)
 {
-	struct proc *p;
+	struct proc *p, **pp;
 	int havekids, pid;
 	struct proc *curproc = myproc();
 
-	acquire(&ptable.lock);
+	acquire(&wait_lock);
 	for (;;)
 	{
-		// Scan through table looking for exited children.
-		havekids = 0;
-		for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+		// Scan through our children looking for exited ones.
+		havekids = curproc->child != 0;
+		for (pp = &curproc->child; (p = *pp) != 0; pp = &p->sibling)
 		{
-			if (p->parent != curproc)
-				continue;
-			havekids = 1;
+			acquire(&p->lock);
 			if (p->state == ZOMBIE)
 			{
 				// Found one.
+				*pp = p->sibling;
 				pid = p->pid;
 				kfree(p->kstack);
 				p->kstack = 0;
 				freevm(p->pgdir);
+				freepid(p);
 				p->pid = 0;
 				p->parent = 0;
+				p->sibling = 0;
 				p->name[0] = 0;
 				p->killed = 0;
 				p->state = UNUSED;
-				release(&ptable.lock);
+				publish(p);
+				release(&p->lock);
+				freeslot(p);
+				release(&wait_lock);
 				return pid;
 			}
+			release(&p->lock);
 		}
 
 		// No point waiting if we don't have any children.
 		if (!havekids || curproc->killed)
 		{
-			release(&ptable.lock);
+			release(&wait_lock);
 			return -1;
 		}
 		// cprintf("We are in the wait stage and it called sleep\n");
 
-		// Wait for children to exit.  (See wakeup1 call in proc_exit.)
-		sleep(curproc, &ptable.lock); //DOC: wait-sleep
+		// Wait for children to exit.  (See wakeup call in proc_exit.)
+		sleep(curproc, &wait_lock); //DOC: wait-sleep
 	}
 }
 
@@ -405,6 +1440,8 @@ int wait(void)
 //  - swtch to start running that process
 //  - eventually that process transfers control
 //      via swtch back to the scheduler.
+//  - halt when there is nothing to run, until an
+//      interrupt or a wakeup IPI arrives.
 void scheduler(void)
 {
 	struct proc *p;
@@ -413,76 +1450,71 @@ void scheduler(void)
 
 	for (;;)
 	{
-		// Enable interrupts on this processor.
-		sti();
-
-		p = head;
-
-		acquire(&ptable.lock);
-
-		// move through queue while it is not empty
-		while (p != 0)
+		// only RUNNABLE processes are queued, so the head is always
+		// the next one to run
+		acquire(&rqlock);
+		if ((p = c->next) != 0)
 		{
-			p = head; // keep pointer at head node on each iteration
-
-			// ensure queue isn't empty
-			if (p == 0) {
-				break;
-			}
-
-			// process doesn't need to be scheduled
-			if (p->state != RUNNABLE)
-			{
-				pop();
-				continue;
-			}
-
-			// check if process needs to be scheduled
-			if (p->activeticks < p->timeslice + p->activesleepticks)
-			{
-				p->schedticks++;
-				p->activeticks++; // increment by one because active for one tick
-				
-				// process has compensation ticks from sleeping
-				if (p->activeticks > p->timeslice)
-				{
-					p->compticks++;
-				}
-
-				// Switch to chosen process.  It is the process's job
-				// to release ptable.lock and then reacquire it
-				// before jumping back to us.
-				c->proc = p;
-				switchuvm(p);
-				p->state = RUNNING;
-				swtch(&(c->scheduler), p->context);
-				switchkvm();
-
-				// Process is done running for now.
-				// It should have changed its p->state before coming back.
-				c->proc = 0;
-			}
-			else
-			{ // process does not need to be scheduled anymore, must remove
-				p->switches++;
-				p->activesleepticks = 0;
-				pop();
-
-				// check if process can be scheduled again
-				if (p->state != SLEEPING)
-				{
-					push(p);
-					p->activeticks = 0; // reset ticks
-					continue;
-				}
-				continue;
-			}
+			// handed the rest of a tick that the process
+			// before it was already charged for
+			c->next = 0;
 		}
-		release(&ptable.lock);
+		else if ((p = dequeue(c)) != 0)
+		{
+			chargetick(p);
+		}
+		else
+		{
+			// Nothing to run. Advertise this CPU as idle while still
+			// holding rqlock, so a wakeup either sees the flag or
+			// queued its process before we looked, then halt with
+			// interrupts enabled.
+			c->idle = 1;
+			c->halted = 1;
+			c->intena = 0; // release must not turn interrupts back on
+			release(&rqlock);
+			stihlt();
+			cli();
+			acquire(&rqlock);
+			c->halted = 0;
+			c->idle = 0;
+			release(&rqlock);
+			continue;
+		}
+		release(&rqlock);
+
+		// Dequeued, so no other CPU can pick p. It is the
+		// process's job to release p->lock and then reacquire
+		// it before jumping back to us.
+		acquire(&p->lock);
+		recordwait(c, p);
+		p->lastcpu = c - cpus;
+		publish(p);
+
+		// Switch to chosen process.
+		c->proc = p;
+		switchuvm(p);
+		p->state = RUNNING;
+		swtch(&(c->scheduler), p->context);
+		switchkvm();
+
+		// Process is done running for now.
+		// It should have changed its p->state before coming back.
+		c->proc = 0;
+
+		// sleeping or exited processes are requeued by wakeup
+		if (p->state == RUNNABLE)
+		{
+			acquire(&rqlock);
+			requeue(p);
+			release(&rqlock);
+		}
+		publish(p);
+		release(&p->lock);
 	}
 }
 
-// Enter scheduler.  Must hold only ptable.lock
+// Enter scheduler.  Must hold only p->lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
@@ -495,8 +1527,8 @@ void sched(void)
 	struct proc *p = myproc();
 	// cprintf("We are in sched and passed the myproc()\n");
 
-	if (!holding(&ptable.lock))
-		panic("sched ptable.lock");
+	if (!holding(&p->lock))
+		panic("sched p->lock");
 	if (mycpu()->ncli != 1)
 		panic("sched locks");
 	if (p->state == RUNNING)
@@ -511,10 +1543,12 @@ void sched(void)
 // Give up the CPU for one scheduling round.
 void yield(void)
 {
-	acquire(&ptable.lock); //DOC: yieldlock
-	myproc()->state = RUNNABLE;
+	struct proc *p = myproc();
+
+	acquire(&p->lock); //DOC: yieldlock
+	p->state = RUNNABLE;
 	sched();
-	release(&ptable.lock);
+	release(&p->lock);
 }
 
 // A fork child's very first scheduling by scheduler()
@@ -522,8 +1556,8 @@ void yield(void)
 void forkret(void)
 {
 	static int first = 1;
-	// Still holding ptable.lock from scheduler.
-	release(&ptable.lock);
+	// Still holding p->lock from scheduler.
+	release(&myproc()->lock);
 
 	if (first)
 	{
@@ -543,6 +1577,7 @@ void forkret(void)
 void sleep(void *chan, struct spinlock *lk)
 {
 	struct proc *p = myproc();
+	struct spinlock *ql;
 
 	if (p == 0)
 		panic("sleep");
@@ -550,75 +1585,146 @@ void sleep(void *chan, struct spinlock *lk)
 	if (lk == 0)
 		panic("sleep without lk");
 
-	// Must acquire ptable.lock in order to
-	// change p->state and then call sched.
-	// Once we hold ptable.lock, we can be
-	// guaranteed that we won't miss any wakeup
-	// (wakeup runs with ptable.lock locked),
-	// so it's okay to release lk.
-	if (lk != &ptable.lock)
-	{						   //DOC: sleeplock0
-		acquire(&ptable.lock); //DOC: sleeplock1
-		release(lk);
-	}
+	// Must acquire chan's wait queue lock and p->lock in
+	// order to change p->state and then call sched.
+	// wakeup takes the wait queue lock before looking
+	// at sleepers, so once we hold it we can't miss a
+	// wakeup and it's okay to release lk. Holding
+	// p->lock keeps wakeup from requeueing us before
+	// sched has switched away.
+	ql = chanlock(chan);
+	acquire(ql); //DOC: sleeplock1
+	acquire(&p->lock);
+	release(lk);
+
 	// Go to sleep.
 	p->chan = chan;
 	p->state = SLEEPING;
 
-	pop(); // remove process from queue
+	p->sleepstart = ticks;
+	if (chan == &ticks)
+	{
+		// timed sleep, caller holds tickslock
+		heapinsert(&timers, p);
+	}
+	else
+	{
+		sleepqadd(p);
+	}
+	release(ql);
+	publish(p);
 	sched();
 
 	// Tidy up.
 	p->chan = 0;
 
 	// Reacquire original lock.
-	if (lk != &ptable.lock)
-	{ //DOC: sleeplock2
-		release(&ptable.lock);
-		acquire(lk);
+	release(&p->lock); //DOC: sleeplock2
+	acquire(lk);
+}
+
+/*
+ * Wake the timed sleepers that are due. Caller holds
+ * tickslock.
+ */
+static void waketimers(void)
+{
+	struct proc *p;
+
+	acquire(&rqlock);
+	if (schedpolicy == SCHED_MLFQ && ticks % MLFQBOOST == 0)
+		mlfqboost();
+	edftick();
+	release(&rqlock);
+
+	// only timed sleepers that are due, earliest deadline first
+	acquire(&timerlock);
+	while (timers.n > 0 && timers.heap[0]->sleepdeadline <= ticks)
+	{
+		p = timers.heap[0];
+		acquire(&p->lock);
+		p->sleepticks += pendingsleepticks(p);
+		heapremove(&timers, p);
+		makerunnable(p);
+		release(&p->lock);
 	}
+	release(&timerlock);
 }
 
 //PAGEBREAK!
-// Wake up all processes sleeping on chan.
-// The ptable lock must be held.
-static void
-wakeup1(void *chan)
+// Wake up all processes sleeping on chan, handing
+// this CPU to the first one if sync is set.
+static int
+wakeup1(void *chan, int sync)
 {
-	struct proc *p;
+	struct sleepq *q;
+	struct proc *p, *next;
+	int handed = 0;
 
-	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+	q = chanq(chan);
+	acquire(&q->lock);
+	for (p = q->head; p != 0; p = next)
 	{
-		if (p->state == SLEEPING && p->chan == chan)
+		next = p->wnext;
+		if (p->chan == chan)
 		{
-			if (chan == &ticks)
-			{
-				if (ticks < p->sleepdeadline)
-				{
-					p->sleepticks++;
-				} else {
-					p->sleepticks++;
-					p->state = RUNNABLE;
-					push(p);
-					p->activeticks = 0;
-				} 
-			}
+			acquire(&p->lock);
+			sleepqremove(p);
+			if (sync && !handed)
+				handed = handoff(p);
 			else
-			{
-				p->state = RUNNABLE;
-				push(p);
-				p->activeticks = 0;
-			}
+				makerunnable(p);
+			release(&p->lock);
 		}
 	}
+	release(&q->lock);
+	return handed;
 }
 
 // Wake up all processes sleeping on chan.
+// Must not be called with any p->lock held.
 void wakeup(void *chan)
 {
-	acquire(&ptable.lock);
-	wakeup1(chan);
-	release(&ptable.lock);
+	if (chan == &ticks)
+	{
+		waketimers();
+		return;
+	}
+	wakeup1(chan, 0);
+}
+
+// Wake up all processes sleeping on chan for a caller
+// that is about to wait for them, such as one end of a
+// pipe waking the other. The first one may be handed the
+// rest of this tick on this CPU; if so wakeupsync returns
+// 1 and the caller should yield() after releasing its
+// locks, or sleep.
+int wakeupsync(void *chan)
+{
+	return wakeup1(chan, 1);
+}
+
+/*
+ * Wake p from its sleep on chan for kill, if it is still
+ * the same process and still asleep there
+ */
+static void wakeproc(struct proc *p, int pid, void *chan)
+{
+	struct spinlock *ql = chanlock(chan);
+
+	acquire(ql);
+	acquire(&p->lock);
+	if (p->pid == pid && p->state == SLEEPING && p->chan == chan)
+	{
+		p->sleepticks += pendingsleepticks(p);
+		if (chan == &ticks)
+			heapremove(&timers, p);
+		else
+			sleepqremove(p);
+		makerunnable(p);
+	}
+	release(&p->lock);
+	release(ql);
 }
 
 // Kill the process with the given pid.
@@ -627,22 +1733,18 @@ void wakeup(void *chan)
 int kill(int pid)
 {
 	struct proc *p;
+	void *chan;
 
-	acquire(&ptable.lock);
-	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-	{
-		if (p->pid == pid)
-		{
-			p->killed = 1;
-			// Wake process from sleep if necessary.
-			if (p->state == SLEEPING)
-				p->state = RUNNABLE;
-			release(&ptable.lock);
-			return 0;
-		}
-	}
-	release(&ptable.lock);
-	return -1;
+	if ((p = findproc(pid)) == 0)
+		return -1;
+	p->killed = 1;
+	chan = p->state == SLEEPING ? p->chan : 0;
+	release(&p->lock);
+	// Wake process from sleep if necessary. The wait
+	// queue lock comes before p->lock, so retake both.
+	if (chan != 0)
+		wakeproc(p, pid, chan);
+	return 0;
 }
 
 //PAGEBREAK: 36
@@ -658,12 +1760,12 @@ void procdump(void)
 		[RUNNABLE] "runble",
 		[RUNNING] "run   ",
 		[ZOMBIE] "zombie"};
-	int i;
+	int i, slot;
 	struct proc *p;
 	char *state;
 	uint pc[10];
 
-	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+	for (slot = 0; (p = procslot(slot)) != 0; slot++)
 	{
 		if (p->state == UNUSED)
 			continue;
@@ -694,20 +1796,15 @@ int setslice(int pid, int slice)
 	{
 		return -1;
 	}
-	acquire(&ptable.lock);
-
 	// search for process with the pid
-	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+	if ((p = findproc(pid)) == 0)
 	{
-		if (p->pid == pid)
-		{
-			p->timeslice = slice;
-			release(&ptable.lock);
-			return 0;
-		}
+		return -1;
 	}
-	release(&ptable.lock);
-	return -1;
+	p->timeslice = slice;
+	publish(p);
+	release(&p->lock);
+	return 0;
 }
 
 /*
@@ -721,19 +1818,16 @@ int getslice(int pid)
 		return -1;
 	}
 	struct proc *p;
-	acquire(&ptable.lock);
+	int slice;
 
 	// search for process with the pid
-	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+	if ((p = findproc(pid)) == 0)
 	{
-		if (p->pid == pid)
-		{
-			release(&ptable.lock);
-			return p->timeslice;
-		}
+		return -1;
 	}
-	acquire(&ptable.lock);
-	return -1;
+	slice = p->timeslice;
+	release(&p->lock);
+	return slice;
 }
 
 /*
@@ -762,11 +1856,15 @@ int fork2(int slice)
 	{
 		kfree(np->kstack);
 		np->kstack = 0;
+		acquire(&np->lock);
 		np->state = UNUSED;
+		freepid(np);
+		publish(np);
+		release(&np->lock);
+		freeslot(np);
 		return -1;
 	}
 	np->sz = curproc->sz;
-	np->parent = curproc;
 	*np->tf = *curproc->tf;
 
 	// Clear %eax so that fork returns 0 in the child.
@@ -781,45 +1879,412 @@ int fork2(int slice)
 
 	pid = np->pid;
 
-	acquire(&ptable.lock);
+	acquire(&wait_lock);
+	np->parent = curproc;
+	np->sibling = curproc->child;
+	curproc->child = np;
+	release(&wait_lock);
+
+	acquire(&np->lock);
 
-	np->state = RUNNABLE;
 	np->timeslice = slice; // set timeslice of process
-	push(np);
+	np->tickets = curproc->tickets;
+	np->stride = STRIDE1 / curproc->tickets; // not what was lent
+	np->affinity = curproc->affinity;
+	makerunnable(np);
 
-	release(&ptable.lock);
+	release(&np->lock);
 
 	return pid;
 }
 
 /*
- * Retrieves the values within the pstat struct
+ * Retrieves the values within the pstat struct from the
+ * published snapshot, without taking any lock
  */
 int getpinfo(struct pstat *ps)
 {
+	struct pubbuf *b = &pubstat.buf[0];
+	uint now;
+	int i;
+
 	if (ps == 0)
 	{
 		return -1;
 	}
 
-	int index = 0;
+	acquire(&pubstat.readlock);
+	pubstat.frozen = 0;
+	__sync_synchronize();
+	now = ticks;
+	pubdrain();
+
+	memmove(ps, &b->ps, sizeof(*ps));
+	for (i = 0; i < NPROC; i++)
+	{
+		if (b->timedsleep[i])
+			ps->sleepticks[i] += now - b->sleepstart[i];
+	}
+
+	// rows published from here on go to both buffers again;
+	// a row left dirty is not, until it is brought up to date
+	pubstat.frozen = -1;
+	__sync_synchronize();
+	for (i = 0; i < NPROC; i++)
+	{
+		acquire(&pubstat.rowlock[i]);
+		if (pubstat.dirty[i])
+		{
+			copyrow(b, &pubstat.buf[1], i);
+			pubstat.dirty[i] = 0;
+		}
+		release(&pubstat.rowlock[i]);
+	}
+	release(&pubstat.readlock);
+
+	ps->ncpu = ncpu;
+	for (i = 0; i < NCPU; i++)
+	{
+		ps->idleticks[i] = i < ncpu ? cpus[i].idleticks : 0;
+	}
+	return 0;
+}
+
+/*
+ * Retrieves the pstat values along with run queue
+ * latency histograms
+ */
+int getpinfo2(struct pstat2 *ps)
+{
+	int i;
 	struct proc *p;
-	acquire(&ptable.lock);
-	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+	struct cpu *c;
+
+	if (ps == 0)
+	{
+		return -1;
+	}
+
+	getpinfo(&ps->ps);
+	for (i = 0; i < NPROC; i++)
+	{
+		if ((p = procslot(i)) == 0)
+		{
+			ps->dispatches[i] = 0;
+			memset(ps->waithist[i], 0, sizeof(ps->waithist[i]));
+			continue;
+		}
+		acquire(&p->lock);
+		ps->dispatches[i] = p->dispatches;
+		memmove(ps->waithist[i], p->waithist, sizeof(p->waithist));
+		release(&p->lock);
+	}
+	// each CPU's histogram is only written by that CPU's
+	// scheduler, a torn copy is off by at most a dispatch
+	for (i = 0; i < NCPU; i++)
+	{
+		c = &cpus[i];
+		ps->cpudispatches[i] = i < ncpu ? c->dispatches : 0;
+		if (i < ncpu)
+			memmove(ps->cpuwaithist[i], c->waithist, sizeof(c->waithist));
+		else
+			memset(ps->cpuwaithist[i], 0, sizeof(ps->cpuwaithist[i]));
+	}
+	return 0;
+}
+
+/*
+ * Sets the stride tickets of process with given pid
+ */
+int settickets(int pid, int tickets)
+{
+	struct proc *p;
+
+	if (tickets < 1 || tickets > MAXTICKETS || pid < 0)
+	{
+		return -1;
+	}
+	if ((p = findproc(pid)) == 0)
+	{
+		return -1;
+	}
+	// the heap is ordered by pass, which is unchanged
+	acquire(&rqlock);
+	p->tickets = tickets;
+	p->stride = STRIDE1 / efftickets(p);
+	release(&rqlock);
+	publish(p);
+	release(&p->lock);
+	return 0;
+}
+
+/*
+ * Switches the scheduling policy, moving every
+ * queued process over to the new policy's queue
+ */
+int setsched(int policy)
+{
+	struct proc *moved = 0; // linked through next, in queue order
+	struct proc **tail = &moved;
+	struct proc *p;
+
+	if (policy != SCHED_RR && policy != SCHED_STRIDE && policy != SCHED_MLFQ)
+	{
+		return -1;
+	}
+	acquire(&rqlock);
+	while ((p = dequeuepolicy(0)) != 0)
+	{
+		p->next = 0;
+		*tail = p;
+		tail = &p->next;
+	}
+	schedpolicy = policy;
+	while ((p = moved) != 0)
+	{
+		moved = p->next;
+		p->activeticks = 0;
+		p->pass = globalpass;
+		p->level = 0;
+		p->levelticks = 0;
+		enqueue(p, 0);
+		publish(p);
+	}
+	release(&rqlock);
+	return 0;
+}
+
+/*
+ * Sets the mask of CPUs the process with given pid may
+ * run on. Bits for CPUs that don't exist are ignored.
+ */
+int setaffinity(int pid, int mask)
+{
+	struct proc *p;
+
+	mask &= (1 << ncpu) - 1;
+	if (mask == 0 || pid < 0)
+	{
+		return -1;
+	}
+	if ((p = findproc(pid)) == 0)
+	{
+		return -1;
+	}
+	// takes effect at its next dispatch
+	acquire(&rqlock);
+	p->affinity = mask;
+	release(&rqlock);
+	release(&p->lock);
+	return 0;
+}
+
+/*
+ * Gets the CPU mask of process with given pid
+ */
+int getaffinity(int pid)
+{
+	struct proc *p;
+	int mask;
+
+	if (pid < 0)
+	{
+		return -1;
+	}
+	if ((p = findproc(pid)) == 0)
+	{
+		return -1;
+	}
+	mask = p->affinity & ((1 << ncpu) - 1);
+	release(&p->lock);
+	return mask;
+}
+
+/*
+ * Fills buf with up to n live processes, starting at
+ * table slot *cursor, and advances *cursor past the last
+ * slot looked at. Returns the number filled in, 0 once
+ * the whole table has been walked.
+ */
+int getprocs(int *cursor, struct procinfo *buf, int n)
+{
+	struct proc *p, *parent;
+	struct procinfo *pi;
+	int i, k = 0;
+
+	if (cursor == 0 || buf == 0 || *cursor < 0 || n < 0)
+	{
+		return -1;
+	}
+	for (i = *cursor; k < n && (p = procslot(i)) != 0; i++)
 	{
-		ps->inuse[index] = 0;
+		acquire(&p->lock);
 		if (p->state != UNUSED)
 		{
-			ps->inuse[index] = 1;
+			pi = &buf[k++];
+			parent = p->parent; // slots outlive processes
+			pi->slot = i;
+			pi->pid = p->pid;
+			pi->ppid = parent ? parent->pid : 0;
+			pi->state = p->state;
+			safestrcpy(pi->name, p->name, sizeof(pi->name));
+			pi->timeslice = p->timeslice;
+			pi->compticks = p->compticks;
+			pi->schedticks = p->schedticks;
+			pi->sleepticks = p->sleepticks + pendingsleepticks(p);
+			pi->switches = p->switches;
+			pi->tickets = p->tickets;
+			pi->pass = p->pass;
+			pi->level = p->level;
+			pi->lastcpu = p->lastcpu;
+			pi->runtime = p->edfruntime;
+			pi->period = p->edfperiod;
+			pi->misses = p->edfmisses;
+			pi->periods = p->edfperiods;
+			pi->dispatches = p->dispatches;
+			memmove(pi->waithist, p->waithist, sizeof(pi->waithist));
 		}
-		ps->pid[index] = p->pid;
-		ps->timeslice[index] = p->timeslice;
-		ps->compticks[index] = p->compticks;
-		ps->schedticks[index] = p->schedticks;
-		ps->sleepticks[index] = p->sleepticks;
-		ps->switches[index] = p->switches;
-		index++;
+		release(&p->lock);
 	}
-	release(&ptable.lock);
+	*cursor = i;
+	return k;
+}
+
+/*
+ * Makes the process with given pid real-time: it gets
+ * runtime ticks of CPU in every period of period ticks,
+ * earliest deadline first and ahead of every normal
+ * process. A runtime of 0 makes it a normal process
+ * again. Fails if admitting it would push the total EDF
+ * utilization over EDFMAXUTIL.
+ */
+int setdeadline(int pid, int runtime, int period)
+{
+	struct proc *p;
+	int util, wasqueued;
+
+	if (pid < 0 || runtime < 0 ||
+		(runtime > 0 && (period < runtime || period > EDFMAXPERIOD)))
+	{
+		return -1;
+	}
+	// round up so admission errs on the safe side
+	util = runtime > 0 ? (runtime * EDFUNIT + period - 1) / period : 0;
+
+	if ((p = findproc(pid)) == 0)
+	{
+		return -1;
+	}
+	acquire(&rqlock);
+	if (edfutil - p->edfutil + util > EDFMAXUTIL)
+	{
+		release(&rqlock);
+		release(&p->lock);
+		return -1;
+	}
+	// move it between the EDF and normal queues
+	wasqueued = p->state == RUNNABLE && queued(p);
+	if (wasqueued)
+		unqueue(p);
+	edfset(p, runtime, period, util);
+	if (wasqueued)
+		enqueue(p, 0);
+	release(&rqlock);
+	publish(p);
+	release(&p->lock);
+	return 0;
+}
+
+/*
+ * Gives the rest of this tick to the process with given
+ * pid, which must be waiting in a run queue and allowed
+ * on this CPU. Fails for a real-time process, or while one
+ * is waiting to run. The caller goes back on the run queue.
+ */
+int yieldto(int pid)
+{
+	struct proc *p;
+	struct cpu *c;
+
+	if (pid < 0 || (p = findproc(pid)) == 0)
+	{
+		return -1;
+	}
+	acquire(&rqlock);
+	c = mycpu();
+	// real-time processes keep their deadline order, as in handoff
+	if (p->state != RUNNABLE || !queued(p) || !canrun(p, c) || c->next != 0 ||
+		p->edfperiod > 0 || edfq.n > 0)
+	{
+		release(&rqlock);
+		release(&p->lock);
+		return -1;
+	}
+	unqueue(p);
+	chargehandoff(myproc());
+	c->next = p;
+	release(&rqlock);
+	release(&p->lock);
+	yield();
 	return 0;
-}
\ No newline at end of file
+}
+
+/*
+ * Lends holder the priority of w, which is about to wait
+ * for a sleeplock holder holds: its timeslice, tickets
+ * and MLFQ level, where they are better than holder's.
+ * The loan lasts until holder lets go of its last
+ * sleeplock. Caller holds the sleeplock's spinlock.
+ */
+void piboost(struct proc *holder, struct proc *w)
+{
+	int wasqueued;
+
+	if (holder == 0 || holder == w)
+	{
+		return;
+	}
+	acquire(&holder->lock);
+	acquire(&rqlock);
+	// requeue it where its new priority puts it
+	wasqueued = holder->state == RUNNABLE && queued(holder);
+	if (wasqueued)
+		unqueue(holder);
+	if (effslice(w) > effslice(holder))
+		holder->pislice = effslice(w);
+	if (efftickets(w) > efftickets(holder))
+	{
+		holder->pitickets = efftickets(w);
+		holder->stride = STRIDE1 / holder->pitickets;
+	}
+	if (w->level < holder->level)
+	{
+		// not given back, MLFQ demotes it again as it runs
+		holder->level = w->level;
+		holder->levelticks = 0;
+	}
+	if (wasqueued)
+		enqueue(holder, holder->pislice > 0);
+	release(&rqlock);
+	publish(holder);
+	release(&holder->lock);
+}
+
+/*
+ * Gives back the priority lent to p by sleeplock waiters
+ */
+void piunboost(struct proc *p)
+{
+	if (p->pislice == 0 && p->pitickets == 0)
+	{
+		return;
+	}
+	acquire(&p->lock);
+	acquire(&rqlock);
+	p->pislice = 0;
+	p->pitickets = 0;
+	p->stride = STRIDE1 / p->tickets;
+	release(&rqlock);
+	publish(p);
+	release(&p->lock);
+}
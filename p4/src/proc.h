@@ -9,6 +9,11 @@ struct cpu {
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
   struct proc *next;		   // The next prcoess in the schedule
+  int idle;                    // Halted waiting for work; cleared by a wakeup IPI
+  int halted;                  // Inside the idle hlt, for idle accounting
+  uint idleticks;              // Timer ticks spent halted with nothing to run
+  uint dispatches;             // Processes dispatched on this cpu
+  uint waithist[NLATBUCKET];   // log2 histogram of their run queue wait, in cycles
 };
 
 extern struct cpu cpus[NCPU];
@@ -37,26 +42,59 @@ enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
 struct proc {
+  struct spinlock lock;        // Protects state, chan, killed and pid
   uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
   char *kstack;                // Bottom of kernel stack for this process
   enum procstate state;        // Process state
   int pid;                     // Process ID
   struct proc *parent;         // Parent process
+  struct proc *child;          // First child, others linked by sibling
+  struct proc *sibling;        // Next child of parent
+  struct proc *hnext;          // Next process in the pid hash chain
+  int slot;                    // Index in the process table
   struct trapframe *tf;        // Trap frame for current syscall
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
+  struct proc *wnext;          // Next sleeper in chan's wait queue
+  struct proc *wprev;          // Previous sleeper in chan's wait queue
   int killed;                  // If non-zero, have been killed
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
-  struct proc *next;  	// pointer to next one
+  struct proc *next;  	// next process in the run queue, or the free list
+  struct proc *prev;  	// previous process in the run queue
+  int inqueue;  	    // non-zero while linked into the run queue
   int timeslice;	    // used for allocated time_slice
   int compticks;  	    // number of compensation ticks this process has used
   int schedticks; 	    // total number of timer ticks this process has been scheduled
+  uint chargedtick;   	// value of ticks when it was last charged a tick
   int sleepticks; 	  	// total number of ticks during which this process was blocked
   int switches;    	    // total num times this process has been scheduled
   uint sleepdeadline; 	// target wake up time
+  uint sleepstart;   	// tick at which the current sleep began
+  int heapindex;   	// slot in the timer or stride heap, -1 if in neither
+  int tickets;   	    // stride scheduling share
+  int stride;    	    // STRIDE1 / tickets, added to pass per tick run
+  uint pass;    	    // stride virtual time, lowest runs first
+  int level;    	    // MLFQ priority level, 0 is the highest
+  int levelticks;   	// ticks used at the current MLFQ level
+  uint64 enqueuetsc;    // TSC when last put on a run queue
+  uint affinity;    	// bit i set if the process may run on cpus[i]
+  int lastcpu;    	    // index of the CPU that last ran this process
+  uint dispatches;    	// number of times taken off a run queue to run
+  uint waithist[NLATBUCKET]; // log2 histogram of run queue wait, in cycles
+  int edfruntime;   	// EDF ticks of CPU per period, 0 if not real-time
+  int edfperiod;    	// EDF period in ticks
+  int edfutil;    	    // edfruntime / edfperiod in EDFUNIT parts
+  int edfbudget;    	// EDF ticks left in the current period
+  uint edfdeadline; 	// tick at which the current EDF period ends
+  int edfmisses;    	// EDF periods that ended before the budget was used
+  int edfperiods;   	// EDF periods elapsed
+  struct proc *edfnext; // next process admitted to EDF
+  int pislice;    	    // timeslice lent by sleeplock waiters, 0 if none
+  int pitickets;    	// stride tickets lent by sleeplock waiters, 0 if none
+  int nsleeplocks;  	// sleeplocks held
   int activeticks;		// track how many ticks this process has used since being awake
   int activesleepticks; // track how many ticks this process has been sleeping 
 };
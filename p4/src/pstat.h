@@ -11,5 +11,49 @@ struct pstat {
   int schedticks[64];  // total number of timer ticks this process has been scheduled
   int sleepticks[64]; // number of ticks during which this process was blocked
   int switches[64];  // total num times this process has been scheduled
+  int tickets[64]; // stride scheduling tickets
+  int pass[64]; // stride scheduling pass value
+  int level[64]; // MLFQ priority level, 0 is the highest
+  int lastcpu[64]; // CPU that last ran this process, -1 if none yet
+  int misses[64]; // EDF deadlines missed
+  int periods[64]; // EDF periods elapsed, 0 if not real-time
+  int ncpu; // number of CPUs in use
+  int idleticks[NCPU]; // number of ticks each CPU spent halted with nothing to run
+};
+
+// getpinfo2() adds run queue latency to struct pstat. Bucket i
+// of a histogram counts waits of [2^i, 2^(i+1)) TSC cycles from
+// enqueue to dispatch; the last bucket also holds anything longer.
+struct pstat2 {
+  struct pstat ps; // same as getpinfo()
+  uint dispatches[64]; // number of times each process was dispatched
+  uint waithist[64][NLATBUCKET]; // run queue wait histogram of each process
+  uint cpudispatches[NCPU]; // number of dispatches on each CPU
+  uint cpuwaithist[NCPU][NLATBUCKET]; // run queue wait histogram of each CPU
+};
+
+// getprocs() fills one of these per live process. Unlike
+// struct pstat it is not limited to the first NPROC slots.
+struct procinfo {
+  int slot; // index in the process table
+  int pid; // PID of the process
+  int ppid; // PID of its parent, 0 if none
+  int state; // UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING or ZOMBIE
+  char name[16]; // process name
+  int timeslice; // number of base ticks this process can run in a timeslice
+  int compticks; // number of compensation ticks this process has used
+  int schedticks; // total number of timer ticks this process has been scheduled
+  int sleepticks; // number of ticks during which this process was blocked
+  int switches; // total num times this process has been scheduled
+  int tickets; // stride scheduling tickets
+  int pass; // stride scheduling pass value
+  int level; // MLFQ priority level, 0 is the highest
+  int lastcpu; // CPU that last ran this process, -1 if none yet
+  int runtime; // EDF ticks of CPU per period, 0 if not real-time
+  int period; // EDF period in ticks
+  int misses; // EDF deadlines missed
+  int periods; // EDF periods elapsed
+  uint dispatches; // number of times the process was dispatched
+  uint waithist[NLATBUCKET]; // its run queue wait histogram
 };
 #endif
\ No newline at end of file
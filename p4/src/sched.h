@@ -0,0 +1,23 @@
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+// Scheduling policies for setsched()
+#define SCHED_RR      0  // round robin with timeslice and compensation ticks
+#define SCHED_STRIDE  1  // stride scheduling, CPU share by tickets
+#define SCHED_MLFQ    2  // multi-level feedback queue
+
+#ifndef SCHEDPOLICY
+#define SCHEDPOLICY SCHED_RR  // policy at boot, make SCHEDPOLICY=n to change
+#endif
+
+#define DEFTICKETS   10  // stride tickets of the first process
+#define MAXTICKETS 1024  // most stride tickets a process can hold
+#define STRIDE1 (1 << 16)  // stride of a process holding one ticket
+
+#define NMLFQ         4  // MLFQ priority levels, 0 is the highest
+#define MLFQBOOST   100  // ticks between MLFQ priority boosts
+
+#define EDFUNIT    1000  // EDF utilization is counted in thousandths of a CPU
+#define EDFMAXUTIL  900  // most total EDF utilization setdeadline() admits
+#define EDFMAXPERIOD 100000  // longest EDF period, in ticks
+#endif
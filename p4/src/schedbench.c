@@ -0,0 +1,250 @@
+#include "types.h"
+#include "user.h"
+#include "pstat.h"
+
+// Scheduler benchmarks. Every result is one line of the form
+//   BENCH <name> key=value key=value ...
+// so runs can be diffed or grepped. Times are in TSC cycles
+// unless the key says ticks. Boot with make qemu CPUS=n to
+// compare throughput at CPUS=1,2,4,8.
+//
+//   schedbench pingpong [rounds]   pipe round trip between two processes
+//   schedbench fair [ticks]        CPU share of fork2 children with slices 1, 2, 4
+//   schedbench wake [iters] [load] lateness of sleep() past its deadline
+//   schedbench tput [nproc]        time for nproc CPU-bound processes to finish
+//   schedbench all                 all of the above with defaults
+
+static struct pstat ps;
+
+static uint64 rdtsc(void) {
+    uint lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64)hi << 32) | lo;
+}
+
+// 64-bit by 32-bit division, there is no libgcc to do it for us
+static uint div64(uint64 n, uint d) {
+    uint64 q = 0, r = 0;
+    for (int i = 63; i >= 0; i--) {
+        r = (r << 1) | ((n >> i) & 1);
+        if (r >= d) {
+            r -= d;
+            q |= (uint64)1 << i;
+        }
+    }
+    return (uint)q;
+}
+
+static int workload(int iters) {
+    int i = 0, j = 0;
+    while (i < iters) {
+        j += i * j + 1;
+        i++;
+    }
+    return j;
+}
+
+static void spin(void) {
+    for (;;) {
+        int w = workload(1000000);
+        kill(-w);  // keep the workload from being optimized out
+    }
+}
+
+static int getncpu(void) {
+    if (getpinfo(&ps) != 0) {
+        return -1;
+    }
+    return ps.ncpu;
+}
+
+static int getschedticks(int pid) {
+    for (int i = 0; i < NPROC; i++) {
+        if (ps.inuse[i] && ps.pid[i] == pid) {
+            return ps.schedticks[i];
+        }
+    }
+    return -1;
+}
+
+// Wait for the next tick edge and return the TSC there.
+static uint64 tickedge(void) {
+    int t = uptime();
+    while (uptime() == t)
+        ;
+    return rdtsc();
+}
+
+static void pingpong(int rounds) {
+    int ping[2], pong[2];
+    char c = 0;
+
+    if (pipe(ping) < 0 || pipe(pong) < 0) {
+        printf(2, "schedbench: pipe failed\n");
+        return;
+    }
+    int pid = fork();
+    if (pid == 0) {
+        for (int i = 0; i < rounds; i++) {
+            read(ping[0], &c, 1);
+            write(pong[1], &c, 1);
+        }
+        exit();
+    }
+
+    int t0 = uptime();
+    uint64 c0 = rdtsc();
+    for (int i = 0; i < rounds; i++) {
+        write(ping[1], &c, 1);
+        read(pong[0], &c, 1);
+    }
+    uint64 c1 = rdtsc();
+    int t1 = uptime();
+    wait();
+
+    close(ping[0]);
+    close(ping[1]);
+    close(pong[0]);
+    close(pong[1]);
+    printf(1, "BENCH pingpong rounds=%d ticks=%d cycles_per_roundtrip=%d\n",
+           rounds, t1 - t0, div64(c1 - c0, rounds));
+}
+
+#define NFAIR 3
+
+static void fair(int window) {
+    int slices[NFAIR] = {1, 2, 4};
+    int pids[NFAIR], before[NFAIR], after[NFAIR];
+    int total = 0, slicesum = 0;
+
+    for (int i = 0; i < NFAIR; i++) {
+        pids[i] = fork2(slices[i]);
+        if (pids[i] == 0) {
+            spin();
+        }
+        slicesum += slices[i];
+    }
+
+    sleep(10);  // let every child get going
+    getpinfo(&ps);
+    for (int i = 0; i < NFAIR; i++) {
+        before[i] = getschedticks(pids[i]);
+    }
+    sleep(window);
+    getpinfo(&ps);
+    for (int i = 0; i < NFAIR; i++) {
+        after[i] = getschedticks(pids[i]);
+        total += after[i] - before[i];
+    }
+
+    for (int i = 0; i < NFAIR; i++) {
+        kill(pids[i]);
+    }
+    for (int i = 0; i < NFAIR; i++) {
+        wait();
+    }
+
+    for (int i = 0; i < NFAIR; i++) {
+        int got = after[i] - before[i];
+        printf(1, "BENCH fair slice=%d ticks=%d share_permille=%d expected_permille=%d\n",
+               slices[i], got, total ? got * 1000 / total : 0, slices[i] * 1000 / slicesum);
+    }
+}
+
+#define NWAKELOAD 16
+
+static void wake(int iters, int load) {
+    int pids[NWAKELOAD];
+    uint64 edge, now, late, sum = 0;
+    uint min = ~0, max = 0;
+
+    if (load > NWAKELOAD) {
+        load = NWAKELOAD;
+    }
+
+    // cycles per tick, averaged over 10 ticks
+    edge = tickedge();
+    for (int i = 0; i < 10; i++) {
+        now = tickedge();
+    }
+    uint cpt = div64(now - edge, 10);
+
+    for (int i = 0; i < load; i++) {
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            spin();
+        }
+    }
+
+    for (int i = 0; i < iters; i++) {
+        edge = tickedge();
+        sleep(2);
+        now = rdtsc();
+        // deadline was the edge two ticks after the one we synced to
+        late = now - edge;
+        late = late > 2 * (uint64)cpt ? late - 2 * (uint64)cpt : 0;
+        sum += late;
+        if (late < min) {
+            min = late;
+        }
+        if (late > max) {
+            max = late;
+        }
+    }
+
+    for (int i = 0; i < load; i++) {
+        kill(pids[i]);
+    }
+    for (int i = 0; i < load; i++) {
+        wait();
+    }
+    printf(1, "BENCH wake iters=%d load=%d cycles_per_tick=%d min=%d avg=%d max=%d\n",
+           iters, load, cpt, min, div64(sum, iters), max);
+}
+
+static void tput(int nproc) {
+    int t0 = uptime();
+
+    for (int i = 0; i < nproc; i++) {
+        if (fork() == 0) {
+            int w = workload(100000000);
+            kill(-w);
+            exit();
+        }
+    }
+    for (int i = 0; i < nproc; i++) {
+        wait();
+    }
+    int t1 = uptime();
+    printf(1, "BENCH tput nproc=%d ncpu=%d ticks=%d\n", nproc, getncpu(), t1 - t0);
+}
+
+static int arg(int argc, char **argv, int i, int def) {
+    return argc > i ? atoi(argv[i]) : def;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf(2, "usage: schedbench pingpong|fair|wake|tput|all [args]\n");
+        exit();
+    }
+
+    if (strcmp(argv[1], "pingpong") == 0) {
+        pingpong(arg(argc, argv, 2, 1000));
+    } else if (strcmp(argv[1], "fair") == 0) {
+        fair(arg(argc, argv, 2, 300));
+    } else if (strcmp(argv[1], "wake") == 0) {
+        wake(arg(argc, argv, 2, 20), arg(argc, argv, 3, 2));
+    } else if (strcmp(argv[1], "tput") == 0) {
+        tput(arg(argc, argv, 2, 8));
+    } else if (strcmp(argv[1], "all") == 0) {
+        pingpong(1000);
+        fair(300);
+        wake(20, 0);
+        wake(20, 2);
+        tput(8);
+    } else {
+        printf(2, "schedbench: unknown benchmark %s\n", argv[1]);
+    }
+    exit();
+}
@@ -6,8 +6,8 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
 #include "sleeplock.h"
 
 void
@@ -17,6 +17,7 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->holder = 0;
 }
 
 void
@@ -24,10 +25,14 @@ acquiresleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
   while (lk->locked) {
+    // don't let a lower priority holder keep us waiting
+    piboost(lk->holder, myproc());
     sleep(lk, &lk->lk);
   }
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  lk->holder = myproc();
+  lk->holder->nsleeplocks++;
   release(&lk->lk);
 }
 
@@ -37,6 +42,9 @@ releasesleep(struct sleeplock *lk)
   acquire(&lk->lk);
   lk->locked = 0;
   lk->pid = 0;
+  if (--lk->holder->nsleeplocks == 0)
+    piunboost(lk->holder);
+  lk->holder = 0;
   wakeup(lk);
   release(&lk->lk);
 }
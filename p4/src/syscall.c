@@ -3,6 +3,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "syscall.h"
@@ -107,6 +108,14 @@ extern int sys_setslice(void);
 extern int sys_getslice(void);
 extern int sys_fork2(void);
 extern int sys_getpinfo(void);
+extern int sys_settickets(void);
+extern int sys_setsched(void);
+extern int sys_getpinfo2(void);
+extern int sys_setaffinity(void);
+extern int sys_getaffinity(void);
+extern int sys_getprocs(void);
+extern int sys_setdeadline(void);
+extern int sys_yieldto(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -134,6 +143,14 @@ static int (*syscalls[])(void) = {
 [SYS_getslice]  sys_getslice,
 [SYS_fork2]   sys_fork2,
 [SYS_getpinfo]  sys_getpinfo,
+[SYS_settickets]  sys_settickets,
+[SYS_setsched]  sys_setsched,
+[SYS_getpinfo2]  sys_getpinfo2,
+[SYS_setaffinity]  sys_setaffinity,
+[SYS_getaffinity]  sys_getaffinity,
+[SYS_getprocs]  sys_getprocs,
+[SYS_setdeadline]  sys_setdeadline,
+[SYS_yieldto]  sys_yieldto,
 };
 
 void
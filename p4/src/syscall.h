@@ -24,3 +24,11 @@
 #define SYS_getslice    23
 #define SYS_fork2   24
 #define SYS_getpinfo    25
+#define SYS_settickets  26
+#define SYS_setsched    27
+#define SYS_getpinfo2   28
+#define SYS_setaffinity 29
+#define SYS_getaffinity 30
+#define SYS_getprocs    31
+#define SYS_setdeadline 32
+#define SYS_yieldto     33
@@ -5,6 +5,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "pstat.h"
 
@@ -154,3 +155,143 @@ int sys_getpinfo(void)
 		return getpinfo(ps);
 	}
 }
+
+/*
+ * Sets stride tickets for desired process
+ */
+int sys_settickets(void)
+{
+	int pid;
+	int tickets;
+	if (argint(0, &pid) < 0 || argint(1, &tickets) < 0)
+	{
+		return -1;
+	}
+	else
+	{
+		return settickets(pid, tickets);
+	}
+}
+
+/*
+ * Selects the scheduling policy
+ */
+int sys_setsched(void)
+{
+	int policy;
+	if (argint(0, &policy) < 0)
+	{
+		return -1;
+	}
+	else
+	{
+		return setsched(policy);
+	}
+}
+
+/*
+ * Retrieves info from pstat2
+ */
+int sys_getpinfo2(void)
+{
+	struct pstat2 *ps;
+	if (argptr(0, (void *)&ps, sizeof(*ps)) < 0) // ps is invalid
+	{
+		return -1;
+	}
+	else
+	{
+		return getpinfo2(ps);
+	}
+}
+
+/*
+ * Pins desired process to a set of CPUs
+ */
+int sys_setaffinity(void)
+{
+	int pid;
+	int mask;
+	if (argint(0, &pid) < 0 || argint(1, &mask) < 0)
+	{
+		return -1;
+	}
+	else
+	{
+		return setaffinity(pid, mask);
+	}
+}
+
+/*
+ * Retrieves CPU mask of desired process
+ */
+int sys_getaffinity(void)
+{
+	int pid;
+	if (argint(0, &pid) < 0)
+	{
+		return -1;
+	}
+	else
+	{
+		return getaffinity(pid);
+	}
+}
+
+/*
+ * Retrieves a batch of process records, resuming at a cursor
+ */
+int sys_getprocs(void)
+{
+	int *cursor;
+	struct procinfo *buf;
+	int n;
+	if (argptr(0, (void *)&cursor, sizeof(*cursor)) < 0 || argint(2, &n) < 0 || n < 0)
+	{
+		return -1;
+	}
+	if (n > MAXPROC) // keeps n * sizeof(*buf) from overflowing
+	{
+		n = MAXPROC;
+	}
+	if (argptr(1, (void *)&buf, n * sizeof(*buf)) < 0) // buf is invalid
+	{
+		return -1;
+	}
+	else
+	{
+		return getprocs(cursor, buf, n);
+	}
+}
+
+/*
+ * Gives desired process an EDF runtime per period
+ */
+int sys_setdeadline(void)
+{
+	int pid, runtime, period;
+	if (argint(0, &pid) < 0 || argint(1, &runtime) < 0 || argint(2, &period) < 0)
+	{
+		return -1;
+	}
+	else
+	{
+		return setdeadline(pid, runtime, period);
+	}
+}
+
+/*
+ * Hands the rest of the current slice to desired process
+ */
+int sys_yieldto(void)
+{
+	int pid;
+	if (argint(0, &pid) < 0)
+	{
+		return -1;
+	}
+	else
+	{
+		return yieldto(pid);
+	}
+}
@@ -3,10 +3,10 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
-#include "spinlock.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
@@ -47,6 +47,8 @@ void trap(struct trapframe *tf)
 	switch (tf->trapno)
 	{
 	case T_IRQ0 + IRQ_TIMER:
+		if (mycpu()->halted)
+			mycpu()->idleticks++;
 		if (cpuid() == 0)
 		{
 			acquire(&tickslock);
@@ -56,6 +58,10 @@ void trap(struct trapframe *tf)
 		}
 		lapiceoi();
 		break;
+	case T_IRQ0 + IRQ_RESCHED:
+		// Only wakes the hlt in scheduler(), which rescans the queue.
+		lapiceoi();
+		break;
 	case T_IRQ0 + IRQ_IDE:
 		ideintr();
 		lapiceoi();
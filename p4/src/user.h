@@ -3,6 +3,8 @@
 struct stat;
 struct rtcdate;
 struct pstat;
+struct pstat2;
+struct procinfo;
 
 // system calls
 int fork(void);
@@ -30,6 +32,14 @@ int getslice(int);
 int setslice(int, int);
 int fork2(int);
 int getpinfo(struct pstat*);
+int settickets(int, int);
+int setsched(int);
+int getpinfo2(struct pstat2*);
+int setaffinity(int, int);
+int getaffinity(int);
+int getprocs(int*, struct procinfo*, int);
+int setdeadline(int, int, int);
+int yieldto(int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -0,0 +1,103 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "pstat.h"
+#include "sched.h"
+
+#define NCHILD 3
+#define TOLERANCE 10  // percent
+
+static int workload(int iters) {
+  int i = 0, j = 0;
+  while (i < iters) {
+    j += i * j + 1;
+    i++;
+  }
+  return j;
+}
+
+
+static struct pstat pstat;
+
+static void get_schedticks(int *pids, int *schedticks) {
+  int pret = getpinfo(&pstat);
+  if (pret != 0) {
+    printf(1, "XV6_SCHEDULER\t getpinfo(&pstat) failed\n");
+    exit();
+  }
+  for (int c = 0; c < NCHILD; ++c) {
+    schedticks[c] = -1;
+    for (int i = 0; i < NPROC; ++i) {
+      if (pstat.inuse[i] == 1 && pstat.pid[i] == pids[c])
+        schedticks[c] = pstat.schedticks[i];
+    }
+    if (schedticks[c] < 0) {
+      printf(1, "XV6_SCHEDULER\t did not find process %d in the fetched pstat\n", pids[c]);
+      exit();
+    }
+  }
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  int tickets[NCHILD] = {10, 20, 30};
+  int pids[NCHILD];
+  int before[NCHILD], after[NCHILD];
+  int total = 0, alltickets = 0, ok = 1;
+
+  if (setsched(SCHED_STRIDE) != 0) {
+    printf(1, "XV6_SCHEDULER\t setsched(SCHED_STRIDE) failed\n");
+    exit();
+  }
+
+  for (int c = 0; c < NCHILD; ++c) {
+    pids[c] = fork();
+    if (pids[c] < 0) {
+      printf(1, "XV6_SCHEDULER\t fork() failed\n");
+      exit();
+    }
+    if (pids[c] == 0) {  // child, spin until killed
+      for (;;) {
+        int w = workload(1000000);
+        kill(-w);  // an unelegant way of "using" the workload value to avoid optimized out
+      }
+    }
+    if (settickets(pids[c], tickets[c]) != 0) {
+      printf(1, "XV6_SCHEDULER\t settickets(%d, %d) failed\n", pids[c], tickets[c]);
+      exit();
+    }
+    alltickets += tickets[c];
+  }
+
+  // Let every child settle in, then measure a window.
+  sleep(20);
+  get_schedticks(pids, before);
+  sleep(300);
+  get_schedticks(pids, after);
+
+  for (int c = 0; c < NCHILD; ++c)
+    total += after[c] - before[c];
+
+  for (int c = 0; c < NCHILD; ++c) {
+    int got = after[c] - before[c];
+    int want = total * tickets[c] / alltickets;
+    int diff = got > want ? got - want : want - got;
+    if (diff * 100 > want * TOLERANCE) {
+      printf(1, "XV6_SCHEDULER\t child with %d tickets ran %d of %d ticks, expected about %d\n",
+             tickets[c], got, total, want);
+      ok = 0;
+    }
+  }
+
+  for (int c = 0; c < NCHILD; ++c)
+    kill(pids[c]);
+  for (int c = 0; c < NCHILD; ++c)
+    wait();
+  setsched(SCHED_RR);
+
+  if (ok)
+    printf(1, "XV6_SCHEDULER\t SUCCESS\n");
+  exit();
+}
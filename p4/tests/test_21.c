@@ -0,0 +1,84 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "pstat.h"
+#include "sched.h"
+
+static int workload(int iters) {
+  int i = 0, j = 0;
+  while (i < iters) {
+    j += i * j + 1;
+    i++;
+  }
+  return j;
+}
+
+
+static struct pstat pstat;
+
+static int get_level(int pid) {
+  int pret = getpinfo(&pstat);
+  if (pret != 0) {
+    printf(1, "XV6_SCHEDULER\t getpinfo(&pstat) failed\n");
+    exit();
+  }
+  for (int i = 0; i < NPROC; ++i) {
+    if (pstat.inuse[i] == 1 && pstat.pid[i] == pid)
+      return pstat.level[i];
+  }
+  printf(1, "XV6_SCHEDULER\t did not find process %d in the fetched pstat\n", pid);
+  exit();
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  if (setsched(SCHED_MLFQ) != 0) {
+    printf(1, "XV6_SCHEDULER\t setsched(SCHED_MLFQ) failed\n");
+    exit();
+  }
+
+  int pid_cpu = fork();
+  if (pid_cpu == 0) {  // CPU-bound child, spin until killed
+    for (;;) {
+      int w = workload(1000000);
+      kill(-w);  // an unelegant way of "using" the workload value to avoid optimized out
+    }
+  }
+
+  int pid_io = fork();
+  if (pid_io == 0) {  // interactive child, mostly blocked
+    for (;;) {
+      sleep(2);
+      int w = workload(1000);
+      kill(-w);
+    }
+  }
+
+  if (pid_cpu < 0 || pid_io < 0) {
+    printf(1, "XV6_SCHEDULER\t fork() failed\n");
+    exit();
+  }
+
+  // Sample half way between two priority boosts.
+  sleep(150 - uptime() % MLFQBOOST);
+
+  int level_cpu = get_level(pid_cpu);
+  int level_io = get_level(pid_io);
+
+  kill(pid_cpu);
+  kill(pid_io);
+  wait();
+  wait();
+  setsched(SCHED_RR);
+
+  if (level_cpu != NMLFQ - 1) {
+    printf(1, "XV6_SCHEDULER\t CPU-bound child at level %d, expected %d\n", level_cpu, NMLFQ - 1);
+  } else if (level_io > 1) {
+    printf(1, "XV6_SCHEDULER\t interactive child demoted to level %d\n", level_io);
+  } else {
+    printf(1, "XV6_SCHEDULER\t SUCCESS\n");
+  }
+  exit();
+}
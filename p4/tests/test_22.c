@@ -0,0 +1,87 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "pstat.h"
+
+#define NCHILD 4
+#define NSAMPLE 20
+
+static int workload(int iters) {
+  int i = 0, j = 0;
+  while (i < iters) {
+    j += i * j + 1;
+    i++;
+  }
+  return j;
+}
+
+
+static struct pstat pstat;
+
+static int get_lastcpu(int pid) {
+  int pret = getpinfo(&pstat);
+  if (pret != 0) {
+    printf(1, "XV6_SCHEDULER\t getpinfo(&pstat) failed\n");
+    exit();
+  }
+  for (int i = 0; i < NPROC; ++i) {
+    if (pstat.inuse[i] == 1 && pstat.pid[i] == pid)
+      return pstat.lastcpu[i];
+  }
+  printf(1, "XV6_SCHEDULER\t did not find process %d in the fetched pstat\n", pid);
+  exit();
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  int pids[NCHILD];
+  int ok = 1;
+
+  for (int c = 0; c < NCHILD; ++c) {
+    pids[c] = fork();
+    if (pids[c] < 0) {
+      printf(1, "XV6_SCHEDULER\t fork() failed\n");
+      exit();
+    }
+    if (pids[c] == 0) {  // child, spin until killed
+      for (;;) {
+        int w = workload(1000000);
+        kill(-w);  // an unelegant way of "using" the workload value to avoid optimized out
+      }
+    }
+    // pin children alternately to CPU 0 and CPU 1
+    if (setaffinity(pids[c], 1 << (c % 2)) != 0) {
+      printf(1, "XV6_SCHEDULER\t setaffinity(%d, %d) failed\n", pids[c], 1 << (c % 2));
+      exit();
+    }
+    if (getaffinity(pids[c]) != 1 << (c % 2)) {
+      printf(1, "XV6_SCHEDULER\t getaffinity(%d) returned %d\n", pids[c], getaffinity(pids[c]));
+      exit();
+    }
+  }
+
+  // Let children that were already running migrate, then sample.
+  sleep(10);
+  for (int s = 0; s < NSAMPLE && ok; ++s) {
+    for (int c = 0; c < NCHILD; ++c) {
+      int cpu = get_lastcpu(pids[c]);
+      if (cpu != c % 2) {
+        printf(1, "XV6_SCHEDULER\t child pinned to cpu %d ran on cpu %d\n", c % 2, cpu);
+        ok = 0;
+        break;
+      }
+    }
+    sleep(5);
+  }
+
+  for (int c = 0; c < NCHILD; ++c)
+    kill(pids[c]);
+  for (int c = 0; c < NCHILD; ++c)
+    wait();
+
+  if (ok)
+    printf(1, "XV6_SCHEDULER\t SUCCESS\n");
+  exit();
+}
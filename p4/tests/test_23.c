@@ -0,0 +1,68 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "pstat.h"
+
+#define NCHILD 100  // more than the NPROC slots a pstat can hold
+#define NINFO 7
+
+static struct procinfo info[NINFO];
+
+int
+main(int argc, char *argv[])
+{
+  int pids[NCHILD];
+  int fds[2];
+  int cursor = 0, n, found = 0, ok = 1;
+  char c;
+
+  if (pipe(fds) != 0) {
+    printf(1, "XV6_SCHEDULER\t pipe() failed\n");
+    exit();
+  }
+
+  for (int i = 0; i < NCHILD; ++i) {
+    pids[i] = fork();
+    if (pids[i] < 0) {
+      printf(1, "XV6_SCHEDULER\t fork() number %d failed\n", i);
+      exit();
+    }
+    if (pids[i] == 0) {  // child, block until the parent closes the pipe
+      close(fds[1]);
+      read(fds[0], &c, 1);
+      exit();
+    }
+  }
+  close(fds[0]);
+
+  // walk the table a few entries at a time
+  while ((n = getprocs(&cursor, info, NINFO)) > 0) {
+    for (int i = 0; i < n; ++i) {
+      if (info[i].ppid != getpid())
+        continue;
+      for (int j = 0; j < NCHILD; ++j) {
+        if (pids[j] == info[i].pid) {
+          pids[j] = -1;  // count each child once
+          found++;
+          break;
+        }
+      }
+    }
+  }
+  if (n < 0) {
+    printf(1, "XV6_SCHEDULER\t getprocs() failed\n");
+    ok = 0;
+  }
+  if (found != NCHILD) {
+    printf(1, "XV6_SCHEDULER\t getprocs() found %d of %d children\n", found, NCHILD);
+    ok = 0;
+  }
+
+  close(fds[1]);
+  for (int i = 0; i < NCHILD; ++i)
+    wait();
+
+  if (ok)
+    printf(1, "XV6_SCHEDULER\t SUCCESS\n");
+  exit();
+}
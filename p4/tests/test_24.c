@@ -0,0 +1,113 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "pstat.h"
+
+#define NTASK 3
+#define NSPIN 2
+#define NTICKS 300
+
+static int runtime[NTASK] = {1, 2, 3};
+static int period[NTASK] = {5, 10, 20};
+
+static int workload(int iters) {
+  int i = 0, j = 0;
+  while (i < iters) {
+    j += i * j + 1;
+    i++;
+  }
+  return j;
+}
+
+static int spawn(void) {
+  int pid = fork();
+  if (pid < 0) {
+    printf(1, "XV6_SCHEDULER\t fork() failed\n");
+    exit();
+  }
+  if (pid == 0) {  // child, spin until killed
+    for (;;) {
+      int w = workload(1000000);
+      kill(-w);  // an unelegant way of "using" the workload value to avoid optimized out
+    }
+  }
+  return pid;
+}
+
+static struct pstat pstat;
+
+static int find(int pid) {
+  for (int i = 0; i < NPROC; ++i) {
+    if (pstat.inuse[i] == 1 && pstat.pid[i] == pid)
+      return i;
+  }
+  printf(1, "XV6_SCHEDULER\t did not find process %d in the fetched pstat\n", pid);
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int tasks[NTASK], spinners[NSPIN];
+  int ok = 1;
+
+  for (int s = 0; s < NSPIN; ++s)
+    spinners[s] = spawn();
+  for (int t = 0; t < NTASK; ++t) {
+    tasks[t] = spawn();
+    if (setdeadline(tasks[t], runtime[t], period[t]) != 0) {
+      printf(1, "XV6_SCHEDULER\t setdeadline(%d, %d, %d) failed\n", tasks[t], runtime[t], period[t]);
+      exit();
+    }
+  }
+  // 55% is admitted, another 90% must not be
+  if (setdeadline(spinners[0], 9, 10) == 0) {
+    printf(1, "XV6_SCHEDULER\t setdeadline admitted more than the utilization limit\n");
+    ok = 0;
+  }
+  if (setdeadline(spinners[0], 5, 4) == 0) {
+    printf(1, "XV6_SCHEDULER\t setdeadline accepted runtime > period\n");
+    ok = 0;
+  }
+
+  sleep(NTICKS);
+
+  if (getpinfo(&pstat) != 0) {
+    printf(1, "XV6_SCHEDULER\t getpinfo(&pstat) failed\n");
+    exit();
+  }
+  for (int t = 0; t < NTASK; ++t) {
+    int i = find(tasks[t]);
+    if (pstat.periods[i] < NTICKS / period[t] - 2) {
+      printf(1, "XV6_SCHEDULER\t task %d saw %d periods\n", t, pstat.periods[i]);
+      ok = 0;
+    }
+    if (pstat.misses[i] != 0) {
+      printf(1, "XV6_SCHEDULER\t task %d missed %d of %d deadlines\n", t, pstat.misses[i], pstat.periods[i]);
+      ok = 0;
+    }
+    // held to its budget
+    if (pstat.schedticks[i] > (pstat.periods[i] + 2) * runtime[t] + 5) {
+      printf(1, "XV6_SCHEDULER\t task %d ran %d ticks in %d periods\n", t, pstat.schedticks[i], pstat.periods[i]);
+      ok = 0;
+    }
+  }
+  for (int s = 0; s < NSPIN; ++s) {
+    int i = find(spinners[s]);
+    if (pstat.periods[i] != 0 || pstat.schedticks[i] < NTICKS / 10) {
+      printf(1, "XV6_SCHEDULER\t normal process %d starved, %d ticks\n", s, pstat.schedticks[i]);
+      ok = 0;
+    }
+  }
+
+  for (int t = 0; t < NTASK; ++t)
+    kill(tasks[t]);
+  for (int s = 0; s < NSPIN; ++s)
+    kill(spinners[s]);
+  for (int k = 0; k < NTASK + NSPIN; ++k)
+    wait();
+
+  if (ok)
+    printf(1, "XV6_SCHEDULER\t SUCCESS\n");
+  exit();
+}
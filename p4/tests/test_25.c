@@ -0,0 +1,94 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define NSPIN 4
+#define NSAMPLE 30
+#define NCHUNK 40  // file larger than the buffer cache, so writes hit the disk
+#define MAXWAIT 8  // ticks; without priority inheritance the writer waits
+                   // behind every spinner on each disk read
+
+static char buf[1024];
+
+static int workload(int iters) {
+  int i = 0, j = 0;
+  while (i < iters) {
+    j += i * j + 1;
+    i++;
+  }
+  return j;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int spinners[NSPIN], writer, fd;
+  int worst = 0, ok = 1;
+  struct stat st;
+
+  // high priority waiter
+  if (setslice(getpid(), 10) != 0) {
+    printf(1, "XV6_SCHEDULER\t setslice(getpid(), 10) failed\n");
+    exit();
+  }
+  if ((fd = open("pifile", O_CREATE | O_RDWR)) < 0) {
+    printf(1, "XV6_SCHEDULER\t open(pifile) failed\n");
+    exit();
+  }
+
+  for (int s = 0; s < NSPIN; ++s) {
+    spinners[s] = fork2(1);
+    if (spinners[s] < 0) {
+      printf(1, "XV6_SCHEDULER\t fork2(1) failed\n");
+      exit();
+    }
+    if (spinners[s] == 0) {  // child, spin until killed
+      for (;;) {
+        int w = workload(1000000);
+        kill(-w);  // an unelegant way of "using" the workload value to avoid optimized out
+      }
+    }
+  }
+
+  // low priority writer, holds the inode lock while it writes
+  writer = fork2(1);
+  if (writer < 0) {
+    printf(1, "XV6_SCHEDULER\t fork2(1) failed\n");
+    exit();
+  }
+  if (writer == 0) {
+    for (;;) {
+      int wfd = open("pifile", O_WRONLY);
+      for (int c = 0; c < NCHUNK; ++c)
+        write(wfd, buf, sizeof(buf));
+      close(wfd);
+    }
+  }
+
+  sleep(10);
+  for (int i = 0; i < NSAMPLE; ++i) {
+    int t0 = uptime();
+    fstat(fd, &st);  // waits for the inode lock
+    int dt = uptime() - t0;
+    if (dt > worst)
+      worst = dt;
+    sleep(1);
+  }
+  if (worst > MAXWAIT) {
+    printf(1, "XV6_SCHEDULER\t waited %d ticks for the inode lock\n", worst);
+    ok = 0;
+  }
+
+  kill(writer);
+  for (int s = 0; s < NSPIN; ++s)
+    kill(spinners[s]);
+  for (int k = 0; k < NSPIN + 1; ++k)
+    wait();
+  close(fd);
+  unlink("pifile");
+
+  if (ok)
+    printf(1, "XV6_SCHEDULER\t SUCCESS\n");
+  exit();
+}
@@ -6,6 +6,7 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "ptentry.h"
 
 struct {
   struct spinlock lock;
@@ -20,6 +21,55 @@ extern void trapret(void);
 
 static void wakeup1(void *chan);
 
+#define NSLEEPQ 61  // number of wait queue buckets, prime
+
+// Sleeping processes, hashed by chan so that wakeup
+// only visits processes that might be sleeping on it.
+// Protected by ptable.lock.
+static struct sleepq {
+  struct proc *head;
+  struct proc *tail;
+} sleepq[NSLEEPQ];
+
+static struct sleepq*
+chanq(void *chan)
+{
+  return &sleepq[((uint)chan >> 2) % NSLEEPQ];
+}
+
+// Append p to the wait queue for p->chan.
+static void
+sleepqadd(struct proc *p)
+{
+  struct sleepq *q = chanq(p->chan);
+
+  p->wnext = 0;
+  p->wprev = q->tail;
+  if(q->tail)
+    q->tail->wnext = p;
+  else
+    q->head = p;
+  q->tail = p;
+}
+
+// Unlink p from the wait queue for p->chan.
+static void
+sleepqremove(struct proc *p)
+{
+  struct sleepq *q = chanq(p->chan);
+
+  if(p->wprev)
+    p->wprev->wnext = p->wnext;
+  else
+    q->head = p->wnext;
+  if(p->wnext)
+    p->wnext->wprev = p->wprev;
+  else
+    q->tail = p->wprev;
+  p->wnext = 0;
+  p->wprev = 0;
+}
+
 void
 pinit(void)
 {
@@ -91,6 +141,9 @@ found:
 
   release(&ptable.lock);
 
+  p->cipher = CIPHER_FLIP;
+  genkey(p);
+
   // Allocate kernel stack.
   if((p->kstack = kalloc()) == 0){
     p->state = UNUSED;
@@ -198,6 +251,10 @@ fork(void)
   }
   np->sz = curproc->sz;
   np->parent = curproc;
+
+  // The child keeps the cipher but not the key.
+  np->cipher = curproc->cipher;
+  recryptuvm(np->pgdir, np->sz, curproc->cipher, curproc->key, np);
   *np->tf = *curproc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
@@ -438,6 +495,7 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  sleepqadd(p);
 
   sched();
 
@@ -457,11 +515,15 @@ sleep(void *chan, struct spinlock *lk)
 static void
 wakeup1(void *chan)
 {
-  struct proc *p;
+  struct proc *p, *next;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
+  for(p = chanq(chan)->head; p != 0; p = next){
+    next = p->wnext;
+    if(p->chan == chan){
+      sleepqremove(p);
       p->state = RUNNABLE;
+    }
+  }
 }
 
 // Wake up all processes sleeping on chan.
@@ -486,8 +548,10 @@ kill(int pid)
     if(p->pid == pid){
       p->killed = 1;
       // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
+      if(p->state == SLEEPING){
+        sleepqremove(p);
         p->state = RUNNABLE;
+      }
       release(&ptable.lock);
       return 0;
     }
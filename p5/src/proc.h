@@ -45,10 +45,14 @@ struct proc {
   struct trapframe *tf;        // Trap frame for current syscall
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
+  struct proc *wnext;          // Next sleeper in chan's wait queue
+  struct proc *wprev;          // Previous sleeper in chan's wait queue
   int killed;                  // If non-zero, have been killed
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  int cipher;                  // Page cipher for encrypted pages (CIPHER_*)
+  uint key[4];                 // Page cipher key
 };
 
 // Process memory is laid out contiguously, low addresses first:
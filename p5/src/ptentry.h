@@ -2,7 +2,14 @@
 #define PT_ENTRY_H
 #include "types.h"
 
-
+/**
+ * Page ciphers selectable with setcipher(). CIPHER_FLIP complements
+ * every bit of the page (the default); CIPHER_XTEA runs XTEA in
+ * counter mode under a per-process key chosen at fork and exec.
+**/
+#define CIPHER_FLIP 0
+#define CIPHER_XTEA 1
+#define NCIPHER     2
 
 /**
  * This structure refers to the state of a virtual page.
@@ -106,6 +106,7 @@ extern int sys_uptime(void);
 extern int sys_mencrypt(void);
 extern int sys_getpgtable(void);
 extern int sys_dump_rawphymem(void);
+extern int sys_setcipher(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -132,6 +133,7 @@ static int (*syscalls[])(void) = {
 [SYS_mencrypt]  sys_mencrypt,
 [SYS_getpgtable]  sys_getpgtable,
 [SYS_dump_rawphymem] sys_dump_rawphymem,
+[SYS_setcipher] sys_setcipher,
 };
 
 void
@@ -23,3 +23,4 @@
 #define SYS_mencrypt    22
 #define SYS_getpgtable  23
 #define SYS_dump_rawphymem  24
+#define SYS_setcipher  25
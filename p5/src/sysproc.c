@@ -135,4 +135,15 @@ sys_dump_rawphymem(void) {
     return -1;
   }
   return dump_rawphymem((uint)physical_addr, buffer);
-}
\ No newline at end of file
+}
+
+// select the page cipher (CIPHER_*) for this process's encrypted pages
+int
+sys_setcipher(void)
+{
+  int cipher;
+
+  if (argint(0, &cipher) < 0)
+    return -1;
+  return setcipher(cipher);
+}
@@ -27,6 +27,7 @@ int uptime(void);
 int mencrypt(char*, int);
 int getpgtable(struct pt_entry*, int);
 int dump_rawphymem(uint, char*);
+int setcipher(int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -11,6 +11,10 @@
 extern char data[]; // defined by kernel.ld
 pde_t *kpgdir;		// for use in scheduler()
 
+// Nonce the ciphertext in each frame was sealed under, needed to
+// open it again. Anything copying a sealed frame copies this too.
+static uint framenonce[PHYSTOP / PGSIZE];
+
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
 void seginit(void)
@@ -345,6 +349,7 @@ copyuvm(pde_t *pgdir, uint sz)
 		if ((mem = kalloc()) == 0)
 			goto bad;
 		memmove(mem, (char *)P2V(pa), PGSIZE);
+		framenonce[V2P(mem) / PGSIZE] = framenonce[pa / PGSIZE];
 		if (mappages(d, (void *)i, PGSIZE, V2P(mem), flags) < 0)
 		{
 			kfree(mem);
@@ -416,6 +421,145 @@ int copyout(pde_t *pgdir, uint va, void *p, uint len)
 //PAGEBREAK!
 // Blank page.
 
+// Page ciphers. Each XORs a keystream over the page, so running
+// crypt again with the same key, va and nonce undoes it; sealing
+// draws a fresh nonce every time (see seal and unseal below).
+// crypt works on the kernel mapping of the frame; va and nonce
+// only seed the keystream.
+struct cipher {
+	int keyed; // output depends on the process key
+	void (*crypt)(uint *key, uint va, uint nonce, uint *page);
+};
+
+// All-ones keystream: complements the page a word at a time,
+// bit-for-bit what the old per-byte flip produced.
+static void
+flipcrypt(uint *key, uint va, uint nonce, uint *page)
+{
+	uint *end = page + PGSIZE / sizeof(uint);
+
+	for (; page < end; page += 4)
+	{
+		page[0] = ~page[0];
+		page[1] = ~page[1];
+		page[2] = ~page[2];
+		page[3] = ~page[3];
+	}
+}
+
+#define XTEADELTA 0x9E3779B9
+#define XTEAROUNDS 32
+
+// XTEA in counter mode. Block i of the page at va is XORed with
+// XTEA(key, va|i, nonce); va is page aligned and i < PGSIZE/8, and
+// every sealing takes a new nonce, so a key never reuses keystream
+// until the 32-bit nonce counter wraps.
+static void
+xteacrypt(uint *key, uint va, uint nonce, uint *page)
+{
+	uint i, r, v0, v1, sum;
+
+	for (i = 0; i < PGSIZE / 8; i++)
+	{
+		v0 = va | i;
+		v1 = nonce;
+		sum = 0;
+		for (r = 0; r < XTEAROUNDS; r++)
+		{
+			v0 += (((v1 << 4) ^ (v1 >> 5)) + v1) ^ (sum + key[sum & 3]);
+			sum += XTEADELTA;
+			v1 += (((v0 << 4) ^ (v0 >> 5)) + v0) ^ (sum + key[(sum >> 11) & 3]);
+		}
+		page[2 * i] ^= v0;
+		page[2 * i + 1] ^= v1;
+	}
+}
+
+static struct cipher ciphers[NCIPHER] = {
+	[CIPHER_FLIP] {0, flipcrypt},
+	[CIPHER_XTEA] {1, xteacrypt},
+};
+
+static uint nextnonce;
+
+// Encrypt the user page at va through its kernel address kva with
+// cipher c under key and a nonce no earlier sealing has used.
+static void
+seal(int c, uint *key, uint va, char *kva)
+{
+	uint nonce = __sync_add_and_fetch(&nextnonce, 1);
+
+	framenonce[V2P(kva) / PGSIZE] = nonce;
+	ciphers[c].crypt(key, va, nonce, (uint *)kva);
+}
+
+// Decrypt what seal left at kva.
+static void
+unseal(int c, uint *key, uint va, char *kva)
+{
+	ciphers[c].crypt(key, va, framenonce[V2P(kva) / PGSIZE], (uint *)kva);
+}
+
+// Pick a fresh page cipher key for p. There is no hardware RNG
+// to lean on, so stir the TSC, pid and a running counter through
+// a multiply-xorshift finalizer.
+void genkey(struct proc *p)
+{
+	static uint seed; // unlocked; a lost update only costs entropy
+	uint x;
+
+	for (int i = 0; i < 4; i++)
+	{
+		seed += XTEADELTA;
+		x = seed ^ (uint)rdtsc() ^ (p->pid << 16);
+		x ^= x >> 16;
+		x *= 0x85EBCA6B;
+		x ^= x >> 13;
+		x *= 0xC2B2AE35;
+		x ^= x >> 16;
+		p->key[i] = x;
+	}
+}
+
+// Re-encrypt every encrypted page of pgdir below sz that was
+// sealed with cipher c under key into p's current cipher and key.
+// fork uses this because copyuvm hands the child the parent's
+// ciphertext; setcipher uses it to switch a live address space.
+void recryptuvm(pde_t *pgdir, uint sz, int c, uint *key, struct proc *p)
+{
+	pte_t *pte;
+	char *kva;
+
+	if (c == p->cipher && (!ciphers[c].keyed || memcmp(key, p->key, sizeof(p->key)) == 0))
+		return;
+	for (uint va = 0; va < sz; va += PGSIZE)
+	{
+		pte = walkpgdir(pgdir, (char *)va, 0);
+		if (!pte || !(*pte & PTE_E))
+			continue;
+		kva = P2V(PTE_ADDR(*pte));
+		unseal(c, key, va, kva);
+		seal(p->cipher, p->key, va, kva);
+	}
+}
+
+// Switch the calling process to cipher c, re-sealing its
+// encrypted pages. Returns 0 on success, -1 for an unknown cipher.
+int setcipher(int c)
+{
+	struct proc *p = myproc();
+	uint key[4];
+	int old;
+
+	if (c < 0 || c >= NCIPHER)
+		return -1;
+	old = p->cipher;
+	memmove(key, p->key, sizeof(key));
+	p->cipher = c;
+	recryptuvm(p->pgdir, p->sz, old, key, p);
+	return 0;
+}
+
 int decrypt(char *uva)
 {
 	struct proc *curproc = myproc();
@@ -423,10 +567,7 @@ int decrypt(char *uva)
 	pte_t *pte = walkpgdir(curproc->pgdir, addr, 0);
 	if (*pte & PTE_E)
 	{
-		char *kaddr = uva2ka(curproc->pgdir, addr);
-      	for (int i = 0; i < PGSIZE; ++i) {
-    		*(kaddr + i) ^= 0xFF;
-		}
+		unseal(curproc->cipher, curproc->key, (uint)addr, P2V(PTE_ADDR(*pte)));
 		*pte = (*pte) | PTE_P;
 		*pte = (*pte) & (~PTE_E);
 
@@ -484,10 +625,7 @@ int mencrypt(char *virtual_addr, int len)
 		}
 		else
 		{
-			char *kaddr = uva2ka(curproc->pgdir, tempaddr);
-      		for (int i = 0; i < PGSIZE; ++i) {
-    			*(kaddr + i) ^= 0xFF;
-			}
+			seal(curproc->cipher, curproc->key, (uint)tempaddr, uva2ka(curproc->pgdir, tempaddr));
 			*pte = (*pte) | PTE_E;
 			*pte = (*pte) & (~PTE_P);
 		}
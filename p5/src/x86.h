@@ -138,6 +138,15 @@ rcr2(void)
   return val;
 }
 
+static inline unsigned long long
+rdtsc(void)
+{
+  uint lo, hi;
+
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((unsigned long long)hi << 32) | lo;
+}
+
 static inline void
 lcr3(uint val)
 {
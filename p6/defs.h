@@ -11,6 +11,11 @@ struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct wset;
+struct wsetinfo;
+struct wsetacct;
+struct wsetcount;
+struct wsetstat;
 struct pt_entry;
 
 typedef uint pte_t;
@@ -73,6 +78,8 @@ char*           kalloc(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+void            kref(char*);
+int             krefs(char*);
 
 // kbd.c
 void            kbdintr(void);
@@ -84,6 +91,7 @@ extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
 void            lapicstartap(uchar, uint);
+void            lapicipi(uchar, int);
 void            microdelay(int);
 
 // log.c
@@ -111,8 +119,9 @@ int             pipewrite(struct pipe*, char*, int);
 int             cpuid(void);
 void            exit(void);
 int             fork(void);
-int             growproc(int);
+int             growproc(int, int);
 int             kill(int);
+int             procwsetinfo(struct wsetinfo*, int, struct wsetacct*);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
 void            pinit(void);
@@ -186,6 +195,9 @@ void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
+int             cowfault(char*);
+int             lazyfault(char*);
+int             lazymap(uint, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
@@ -199,6 +211,26 @@ int				wsetinsert(char*, struct proc*);
 int				wsetdelete(char*);
 void            clearwset(void);
 int				searchwset(char*);
+void            wsetinit(struct wset*);
+int             setwsetsize(int);
+void            prefetch(char*);
+void            wsetpoolinit(void);
+struct wset*    wsetalloc(void);
+void            wsetcopy(struct wset*, struct wset*);
+void            wsetfree(struct wset*);
+void            pffupdate(char*);
+void            pfftick(void);
+void            encqinit(void);
+void            encqflush(struct proc*, int);
+void            encqwork(int);
+void            tlbpoll(void);
+void            tlbflush(pde_t*, char*, uint);
+int             getwsetstat(struct wsetstat*, struct wsetinfo*, int);
+void            wsetacctadd(struct wsetacct*, struct wsetacct*);
+void            wsetacctreport(struct wsetacct*, struct wsetcount*);
+void            wsetretire(struct wsetacct*);
+void            genkey(struct proc*);
+int             setcipher(int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
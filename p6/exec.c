@@ -2,6 +2,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "ptentry.h"
 #include "proc.h"
 #include "defs.h"
 #include "x86.h"
@@ -104,6 +105,9 @@ int exec(char *path, char **argv)
 	switchuvm(curproc);
 
 	clearwset();
+	curproc->pfnext = PFNONE;
+	curproc->pfwindow = 0;
+	genkey(curproc);
 	// NEED TO: encrypt with myproc->pgdir
 	for (int i = 0; i < sz; i += PGSIZE)
 	{
@@ -117,6 +121,7 @@ int exec(char *path, char **argv)
 		}
 	}
 
+	encqflush(curproc, 0);
 	freevm(oldpgdir);
 	return 0;
 
@@ -27,6 +27,8 @@ main(void)
   consoleinit();   // console hardware
   uartinit();      // serial port
   pinit();         // process table
+  wsetpoolinit();  // working set budget
+  encqinit();      // background page encryption
   tvinit();        // trap vectors
   binit();         // buffer cache
   fileinit();      // file table
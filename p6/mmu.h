@@ -96,6 +96,8 @@ struct segdesc {
 #define PTE_U           0x004   // User
 #define PTE_PS          0x080   // Page Size
 #define PTE_E           0x200   // Encrypted
+#define PTE_Q           0x400   // Evicted, queued for encryption
+#define PTE_COW         0x800   // Shared copy-on-write, PTE_W held back
 #define PTE_A           0x020   // reference bit
 
 // Address in page table or page directory entry
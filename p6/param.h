@@ -11,4 +11,12 @@
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
-#define CLOCKSIZE 8   // CLOCKSIZE represents N above
+#define CLOCKSIZE 8   // default working set size (see setwsetsize)
+#define WSETMAX    256  // largest working set size
+#define WSETBUDGET 2048 // decrypted pages all working sets may hold
+#define PFFWINDOW  10   // ticks over which page fault frequency is measured
+#define PFFHIGH    32   // faults per window above which a working set grows
+#define PFFLOW     4    // faults per window below which it shrinks
+#define NENCQ      64   // evicted pages queued for encryption per CPU
+#define NENCBATCH  8    // queued pages encrypted per scheduler pass
+#define TLBFLUSHMAX 32  // pages past which a full TLB flush beats invlpg
@@ -22,6 +22,60 @@ extern void trapret(void);
 
 static void wakeup1(void *chan);
 
+#define NSLEEPQ 61 // number of wait queue buckets, prime
+
+/*
+ * Sleeping processes, hashed by chan so that wakeup
+ * only visits processes that might be sleeping on it.
+ * Protected by ptable.lock.
+ */
+static struct sleepq
+{
+	struct proc *head;
+	struct proc *tail;
+} sleepq[NSLEEPQ];
+
+static struct sleepq *
+chanq(void *chan)
+{
+	return &sleepq[((uint)chan >> 2) % NSLEEPQ];
+}
+
+/*
+ * Append p to the wait queue for p->chan
+ */
+static void sleepqadd(struct proc *p)
+{
+	struct sleepq *q = chanq(p->chan);
+
+	p->wnext = 0;
+	p->wprev = q->tail;
+	if (q->tail)
+		q->tail->wnext = p;
+	else
+		q->head = p;
+	q->tail = p;
+}
+
+/*
+ * Unlink p from the wait queue for p->chan
+ */
+static void sleepqremove(struct proc *p)
+{
+	struct sleepq *q = chanq(p->chan);
+
+	if (p->wprev)
+		p->wprev->wnext = p->wnext;
+	else
+		q->head = p->wnext;
+	if (p->wnext)
+		p->wnext->wprev = p->wprev;
+	else
+		q->tail = p->wprev;
+	p->wnext = 0;
+	p->wprev = 0;
+}
+
 void pinit(void)
 {
 	initlock(&ptable.lock, "ptable");
@@ -94,12 +148,29 @@ found:
 
 	release(&ptable.lock);
 
+	p->cipher = CIPHER_FLIP;
+	genkey(p);
+
 	// Allocate kernel stack.
 	if ((p->kstack = kalloc()) == 0)
 	{
 		p->state = UNUSED;
 		return 0;
 	}
+	if ((p->wset = wsetalloc()) == 0)
+	{
+		kfree(p->kstack);
+		p->kstack = 0;
+		p->state = UNUSED;
+		return 0;
+	}
+	p->pffauto = 1;
+	p->pffstart = ticks;
+	p->pffaults = 0;
+	p->pffrate = 0;
+	memset(&p->wacct, 0, sizeof(p->wacct));
+	p->pfnext = PFNONE;
+	p->pfwindow = 0;
 	sp = p->kstack + KSTACKSIZE;
 
 	// Leave room for trap frame.
@@ -156,15 +227,25 @@ void userinit(void)
 	release(&ptable.lock);
 }
 
-// Grow current process's memory by n bytes.
+// Grow current process's memory by n bytes. Growth only
+// reserves the addresses; each page is allocated zeroed on
+// first touch (see lazyfault), unless flags has SBRK_POPULATE.
 // Return 0 on success, -1 on failure.
-int growproc(int n)
+int growproc(int n, int flags)
 {
 	uint sz;
 	struct proc *curproc = myproc();
 
 	sz = curproc->sz;
-	if (n > 0)
+	if (n > 0 && (sz + n > KERNBASE || sz + n < sz))
+	{
+		return -1;
+	}
+	else if (n > 0 && !(flags & SBRK_POPULATE))
+	{
+		sz += n;
+	}
+	else if (n > 0)
 	{
 		if ((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
 		{
@@ -172,8 +253,9 @@ int growproc(int n)
 		}
 		else
 		{
-			// mencrypt the increased pages
-			if (mencrypt((char *)(sz - n), n / PGSIZE) != 0)
+			// mencrypt the new pages
+			uint a = PGROUNDUP(curproc->sz);
+			if (mencrypt((char *)a, (PGROUNDUP(sz) - a) / PGSIZE) != 0)
 			{
 				return -1;
 			}
@@ -181,19 +263,18 @@ int growproc(int n)
 	}
 	else if (n < 0)
 	{
+		encqflush(curproc, 1);
 		if ((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
 		{
 			return -1;
 		}
 		else
 		{
-			// remove pages from queue, from sz, sz-PGSIZE, sz-2*PGSIZE, ... sz + n
-			for (int i = 0; i < (-n / PGSIZE); i++)
+			// remove the freed pages from the working set; only
+			// the decrypted ones are in it
+			for (uint a = PGROUNDUP(sz); a < PGROUNDUP(curproc->sz); a += PGSIZE)
 			{
-				if (wsetdelete((char *)(sz - i * PGSIZE)) != 0)
-				{
-					return -1;
-				}
+				wsetdelete((char *)a);
 			}
 		}
 	}
@@ -218,31 +299,31 @@ int fork(void)
 		return -1;
 	}
 
-	// Clear the child's queue
-	for (int i = 0; i < CLOCKSIZE; i++)
-	{
-		np->clockqueue[i] = (char *)-1;
-	}
-	np->clockhand = -1;
-
-	// Copy process state from proc.
+	// Copy process state from proc. Encrypt the pages still
+	// queued first, since copyuvm shares only mapped or encrypted ones.
+	encqflush(curproc, 1);
 	if ((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0)
 	{
 		kfree(np->kstack);
 		np->kstack = 0;
+		wsetfree(np->wset);
+		np->wset = 0;
 		np->state = UNUSED;
 		return -1;
 	}
 	np->sz = curproc->sz;
 	np->parent = curproc;
+
+	// The child keeps the cipher but gets its own key from allocproc.
+	// The ciphertext it shares copy-on-write opens with whatever key
+	// sealed it (see frameseals); whatever the child seals again is
+	// sealed under its own.
+	np->cipher = curproc->cipher;
 	*np->tf = *curproc->tf;
 
-	// Copy the parent's queue to the child's
-	for (int i = 0; i < CLOCKSIZE; i++)
-	{
-		np->clockqueue[i] = curproc->clockqueue[i];
-	}
-	np->clockhand = curproc->clockhand;
+	// Copy the parent's working set to the child's
+	wsetcopy(np->wset, curproc->wset);
+	np->pffauto = curproc->pffauto;
 
 	// Clear %eax so that fork returns 0 in the child.
 	np->tf->eax = 0;
@@ -287,6 +368,8 @@ void exit(void)
 		}
 	}
 
+	encqflush(curproc, 0);
+
 	begin_op();
 	iput(curproc->cwd);
 	end_op();
@@ -338,6 +421,9 @@ int wait(void)
 				pid = p->pid;
 				kfree(p->kstack);
 				p->kstack = 0;
+				wsetretire(&p->wacct);
+				wsetfree(p->wset);
+				p->wset = 0;
 				freevm(p->pgdir);
 				p->pid = 0;
 				p->parent = 0;
@@ -400,8 +486,16 @@ void scheduler(void)
 			// Process is done running for now.
 			// It should have changed its p->state before coming back.
 			c->proc = 0;
+
+			// Encrypt what it evicted here before the next one runs.
+			release(&ptable.lock);
+			encqwork(c - cpus);
+			acquire(&ptable.lock);
 		}
 		release(&ptable.lock);
+
+		// Encrypt pages evicted on this CPU even while it is idle.
+		encqwork(c - cpus);
 	}
 }
 
@@ -486,6 +580,7 @@ void sleep(void *chan, struct spinlock *lk)
 	// Go to sleep.
 	p->chan = chan;
 	p->state = SLEEPING;
+	sleepqadd(p);
 
 	sched();
 
@@ -506,11 +601,17 @@ void sleep(void *chan, struct spinlock *lk)
 static void
 wakeup1(void *chan)
 {
-	struct proc *p;
+	struct proc *p, *next;
 
-	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-		if (p->state == SLEEPING && p->chan == chan)
+	for (p = chanq(chan)->head; p != 0; p = next)
+	{
+		next = p->wnext;
+		if (p->chan == chan)
+		{
+			sleepqremove(p);
 			p->state = RUNNABLE;
+		}
+	}
 }
 
 // Wake up all processes sleeping on chan.
@@ -536,7 +637,10 @@ int kill(int pid)
 			p->killed = 1;
 			// Wake process from sleep if necessary.
 			if (p->state == SLEEPING)
+			{
+				sleepqremove(p);
 				p->state = RUNNABLE;
+			}
 			release(&ptable.lock);
 			return 0;
 		}
@@ -581,3 +685,32 @@ void procdump(void)
 		cprintf("\n");
 	}
 }
+
+// Fill in the working set of up to num live processes and add the
+// counters of all of them to *total. procs must be kernel memory,
+// as it is written with ptable.lock held.
+// Returns the number of entries filled.
+int procwsetinfo(struct wsetinfo *procs, int num, struct wsetacct *total)
+{
+	struct proc *p;
+	int n = 0;
+
+	acquire(&ptable.lock);
+	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+	{
+		if (p->state == UNUSED || p->state == EMBRYO || p->wset == 0)
+			continue;
+		wsetacctadd(total, &p->wacct);
+		if (n >= num)
+			continue;
+		procs[n].pid = p->pid;
+		procs[n].size = p->wset->size;
+		procs[n].resident = p->wset->count;
+		procs[n].adaptive = p->pffauto;
+		procs[n].faultrate = p->pffrate;
+		wsetacctreport(&p->wacct, &procs[n].count);
+		n++;
+	}
+	release(&ptable.lock);
+	return n;
+}
@@ -8,6 +8,8 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  volatile uint tlbreq;        // TLB shootdowns asked of this cpu
+  volatile uint tlback;        // TLB shootdowns it has done
 };
 
 extern struct cpu cpus[NCPU];
@@ -32,6 +34,32 @@ struct context {
   uint eip;
 };
 
+// Working set: a CLOCK ring of page addresses and an open-addressing
+// hash from VPN to ring slot. Fits in the one page kalloc'd per process.
+#define WSETHASH  (2 * WSETMAX)    // hash slots; a power of two
+#define WSETEMPTY ((char *)-1)     // free ring slot
+
+struct wset {
+  int size;                    // Ring slots in use, at most WSETMAX
+  int count;                   // Occupied ring slots
+  int hand;                    // CLOCK hand, last slot examined
+  int nfree;                   // Entries on free
+  char *ring[WSETMAX];         // Page address per slot, or WSETEMPTY
+  short hash[WSETHASH];        // Ring slot by VPN, or -1
+  short free[WSETMAX];         // Stack of empty slots below size
+};
+
+#define PFNONE    ((uint)-1)       // pfnext before any fault
+
+// Working set counters of one process. Cycles are kept in full and
+// scaled to the kilocycles of n.kc* only when reported.
+struct wsetacct {
+  struct wsetcount n;
+  unsigned long long cdecrypt;
+  unsigned long long cencrypt;
+  unsigned long long cinsert;
+};
+
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -45,12 +73,22 @@ struct proc {
   struct trapframe *tf;        // Trap frame for current syscall
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
+  struct proc *wnext;          // Next sleeper in chan's wait queue
+  struct proc *wprev;          // Previous sleeper in chan's wait queue
   int killed;                  // If non-zero, have been killed
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
-  char *clockqueue[CLOCKSIZE];  // process's clockqueue
-  int clockhand;				// int value of where the hand is in the queue
+  struct wset *wset;           // Working set of decrypted pages
+  int pffauto;                 // Working set sized by fault frequency
+  uint pffstart;               // Tick the current PFF window began
+  int pffaults;                // Faults so far in this window
+  int pffrate;                 // Faults per window, last measured
+  struct wsetacct wacct;       // Working set and encryption counters
+  uint pfnext;                 // VPN a sequential fault would hit next, or PFNONE
+  int pfwindow;                // Pages decrypted ahead on that fault
+  int cipher;                  // Page cipher for encrypted pages (CIPHER_*)
+  uint key[4];                 // Page cipher key
 };
 
 // Process memory is laid out contiguously, low addresses first:
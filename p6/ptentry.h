@@ -2,7 +2,20 @@
 #define PT_ENTRY_H
 #include "types.h"
 
+/**
+ * Page ciphers selectable with setcipher(). CIPHER_FLIP complements
+ * every bit of the page (the default); CIPHER_XTEA runs XTEA in
+ * counter mode under a per-process key chosen at fork and exec.
+**/
+#define CIPHER_FLIP 0
+#define CIPHER_XTEA 1
+#define NCIPHER     2
 
+/**
+ * sbrkflags() flag: allocate and encrypt the new pages right away
+ * instead of on first touch.
+**/
+#define SBRK_POPULATE 0x1
 
 /**
  * This structure refers to the state of a virtual page.
@@ -58,4 +71,81 @@ struct pt_entry {
     uint ref : 1;
 };
 
+/**
+ * Working set and encryption counters, kept per process and summed
+ * over all processes that ever ran.
+**/
+struct wsetcount {
+    /**
+     * Faults on encrypted pages, and pages decrypted (readahead included)
+    */
+    uint faults;
+    uint decrypts;
+
+    /**
+     * Working set victims, and reference bits cleared to give a
+     * page a second chance
+    */
+    uint evictions;
+    uint refclears;
+
+    /**
+     * Working set insertions, and clock hand steps taken by them
+    */
+    uint inserts;
+    uint sweeps;
+
+    /**
+     * Kilocycles spent in mdecrypt, mencrypt and wsetinsert
+    */
+    uint kcdecrypt;
+    uint kcencrypt;
+    uint kcinsert;
+};
+
+/**
+ * Working set budget, filled in by getwsetstat().
+**/
+struct wsetstat {
+    /**
+     * Decrypted pages all working sets together may hold
+    */
+    uint budget;
+
+    /**
+     * Sum of all working set sizes
+    */
+    uint used;
+
+    /**
+     * Counters summed over every process, live or gone
+    */
+    struct wsetcount count;
+};
+
+/**
+ * Working set of one process, filled in by getwsetstat().
+**/
+struct wsetinfo {
+    int pid;
+
+    /**
+     * Pages the working set may hold, and pages it holds now
+    */
+    int size;
+    int resident;
+
+    /**
+     * 1 if the size follows the page fault rate, 0 if set by setwsetsize()
+    */
+    int adaptive;
+
+    /**
+     * Encrypted-page faults per PFFWINDOW ticks, last measured
+    */
+    int faultrate;
+
+    struct wsetcount count;
+};
+
 #endif // __PT_ENTRY_H__
@@ -21,6 +21,8 @@ fetchint(uint addr, int *ip)
 
   if(addr >= curproc->sz || addr+4 > curproc->sz)
     return -1;
+  if(lazymap(addr, 4) < 0)
+    return -1;
   *ip = *(int*)(addr);
   return 0;
 }
@@ -39,6 +41,9 @@ fetchstr(uint addr, char **pp)
   *pp = (char*)addr;
   ep = (char*)curproc->sz;
   for(s = *pp; s < ep; s++){
+    // map untouched sbrk pages before reading them
+    if((s == *pp || (uint)s % PGSIZE == 0) && lazymap((uint)s, 1) < 0)
+      return -1;
     if(*s == 0)
       return s - *pp;
   }
@@ -54,7 +59,8 @@ argint(int n, int *ip)
 
 // Fetch the nth word-sized system call argument as a pointer
 // to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
+// lies within the process address space, and map any sbrk
+// pages in it that were never touched.
 int
 argptr(int n, char **pp, int size)
 {
@@ -65,6 +71,8 @@ argptr(int n, char **pp, int size)
     return -1;
   if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
     return -1;
+  if(lazymap(i, size) < 0)
+    return -1;
   *pp = (char*)i;
   return 0;
 }
@@ -105,6 +113,10 @@ extern int sys_write(void);
 extern int sys_uptime(void);
 extern int sys_getpgtable(void);
 extern int sys_dump_rawphymem(void);
+extern int sys_setcipher(void);
+extern int sys_setwsetsize(void);
+extern int sys_getwsetstat(void);
+extern int sys_sbrkflags(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -130,6 +142,10 @@ static int (*syscalls[])(void) = {
 [SYS_close]   sys_close,
 [SYS_getpgtable]  sys_getpgtable,
 [SYS_dump_rawphymem] sys_dump_rawphymem,
+[SYS_setcipher] sys_setcipher,
+[SYS_setwsetsize] sys_setwsetsize,
+[SYS_getwsetstat] sys_getwsetstat,
+[SYS_sbrkflags] sys_sbrkflags,
 };
 
 void
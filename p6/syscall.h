@@ -22,3 +22,7 @@
 #define SYS_close  21
 #define SYS_getpgtable  22
 #define SYS_dump_rawphymem  23
+#define SYS_setcipher  24
+#define SYS_setwsetsize  25
+#define SYS_getwsetstat  26
+#define SYS_sbrkflags  27
@@ -52,7 +52,22 @@ sys_sbrk(void)
   if(argint(0, &n) < 0)
     return -1;
   addr = myproc()->sz;
-  if(growproc(n) < 0)
+  if(growproc(n, 0) < 0)
+    return -1;
+  return addr;
+}
+
+// sbrk with SBRK_* flags
+int
+sys_sbrkflags(void)
+{
+  int addr;
+  int n, flags;
+
+  if(argint(0, &n) < 0 || argint(1, &flags) < 0)
+    return -1;
+  addr = myproc()->sz;
+  if(growproc(n, flags) < 0)
     return -1;
   return addr;
 }
@@ -120,4 +135,44 @@ sys_dump_rawphymem(void) {
     return -1;
   }
   return dump_rawphymem((uint)physical_addr, buffer);
-}
\ No newline at end of file
+}
+
+// select the page cipher (CIPHER_*) for this process's encrypted pages
+int
+sys_setcipher(void)
+{
+  int cipher;
+
+  if (argint(0, &cipher) < 0)
+    return -1;
+  return setcipher(cipher);
+}
+
+// set how many decrypted pages this process may keep (1..WSETMAX),
+// or 0 to let its page fault rate decide
+int
+sys_setwsetsize(void)
+{
+  int n;
+
+  if (argint(0, &n) < 0)
+    return -1;
+  return setwsetsize(n);
+}
+
+// report the working set budget and per-process working sets
+int
+sys_getwsetstat(void)
+{
+  struct wsetstat *st;
+  struct wsetinfo *procs;
+  int num;
+
+  if (argint(2, &num) < 0 || num < 0 || argptr(0, (void *)&st, sizeof(*st)) < 0)
+    return -1;
+  if (num > NPROC) // keeps num * sizeof(*procs) from overflowing
+    num = NPROC;
+  if (argptr(1, (void *)&procs, num * sizeof(*procs)) < 0)
+    return -1;
+  return getwsetstat(st, procs, num);
+}
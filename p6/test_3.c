@@ -18,8 +18,8 @@ int main(void) {
     while ((uint)buffer != 0x6000)
         buffer = sbrk(PGSIZE * sizeof(char));
     
-    // Allocate one pages of space
-    sbrk(PAGES_NUM * PGSIZE);
+    // Allocate one pages of space, populated so it is encrypted now
+    sbrkflags(PAGES_NUM * PGSIZE, SBRK_POPULATE);
     struct pt_entry pt_entries[PAGES_NUM];
 
     int retval = getpgtable(pt_entries, PAGES_NUM, 0);
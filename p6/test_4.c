@@ -0,0 +1,139 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "ptentry.h"
+
+#define PGSIZE 4096
+#define PAGES_NUM 32
+#define ENTRIES_NUM 512
+
+static struct pt_entry entries[ENTRIES_NUM];
+
+static int
+err(char *msg) {
+    printf(1, "XV6_TEST_OUTPUT %s\n", msg);
+    exit();
+}
+
+static int
+errpage(char *msg, int page) {
+    printf(1, "XV6_TEST_OUTPUT %s in page %d\n", msg, page);
+    exit();
+}
+
+static char
+pattern(int tag, int page, int j) {
+    return (char)(tag + page * 7 + j);
+}
+
+static void
+fill(char *buf, int tag) {
+    for (int i = 0; i < PAGES_NUM; i++)
+        for (int j = 0; j < PGSIZE; j++)
+            buf[i * PGSIZE + j] = pattern(tag, i, j);
+}
+
+// First page of buf not holding tag's pattern, or -1
+static int
+verify(char *buf, int tag) {
+    for (int i = 0; i < PAGES_NUM; i++)
+        for (int j = 0; j < PGSIZE; j++)
+            if (buf[i * PGSIZE + j] != pattern(tag, i, j))
+                return i;
+    return -1;
+}
+
+// Page table entry for va, or 0 if va is not mapped
+static struct pt_entry *
+lookup(char *va) {
+    int n = getpgtable(entries, ENTRIES_NUM, 0);
+    for (int i = 0; i < n; i++)
+        if (entries[i].pdx == ((uint)va >> 22) && entries[i].ptx == (((uint)va >> 12) & 0x3FF))
+            return &entries[i];
+    return 0;
+}
+
+int main(void) {
+    if (setcipher(CIPHER_XTEA) != 0)
+        err("setcipher(CIPHER_XTEA) failed");
+
+    // More pages than the working set holds, so most are encrypted
+    char *buf = sbrkflags(PAGES_NUM * PGSIZE, SBRK_POPULATE);
+    if (buf == (char *)-1)
+        err("sbrkflags failed");
+    fill(buf, 1);
+
+    // Pick a page that is out of the working set; nothing touches it
+    // in the parent until the children are gone
+    char *cold = 0;
+    for (int i = 0; i < PAGES_NUM && cold == 0; i++) {
+        struct pt_entry *e = lookup(buf + i * PGSIZE);
+        if (e != 0 && !e->present)
+            cold = buf + i * PGSIZE;
+    }
+    if (cold == 0)
+        err("no page of the buffer was evicted");
+    uint coldpage = lookup(cold)->ppage;
+
+    int pid = fork();
+    if (pid < 0)
+        err("fork failed");
+    if (pid == 0) {
+        struct pt_entry *e = lookup(cold);
+        if (e == 0 || e->ppage != coldpage)
+            err("child does not share the parent's page");
+        if (e->writable)
+            err("shared page is writable in the child");
+
+        // Reading pages sealed with the parent's key
+        int bad = verify(buf, 1);
+        if (bad >= 0)
+            errpage("child read wrong inherited data", bad);
+
+        // Writing breaks the sharing
+        cold[0] = ~cold[0];
+        e = lookup(cold);
+        if (e == 0 || e->ppage == coldpage)
+            err("write in the child did not copy the page");
+        cold[0] = ~cold[0];
+        fill(buf, 2);
+
+        int gpid = fork();
+        if (gpid < 0)
+            err("fork of a forked child failed");
+        if (gpid == 0) {
+            bad = verify(buf, 2);
+            if (bad >= 0)
+                errpage("grandchild read wrong data", bad);
+            // Re-sealing under another cipher stays private too
+            if (setcipher(CIPHER_FLIP) != 0)
+                err("setcipher(CIPHER_FLIP) failed");
+            fill(buf, 3);
+            bad = verify(buf, 3);
+            if (bad >= 0)
+                errpage("grandchild lost its own data", bad);
+            exit();
+        }
+        wait();
+        bad = verify(buf, 2);
+        if (bad >= 0)
+            errpage("grandchild's writes reached the child", bad);
+        exit();
+    }
+    wait();
+
+    // The children are gone, so the parent holds the only reference
+    // and decrypting the page must not copy it
+    if (cold[0] != pattern(1, (cold - buf) / PGSIZE, 0))
+        err("parent's cold page changed");
+    struct pt_entry *e = lookup(cold);
+    if (e == 0 || e->ppage != coldpage)
+        err("page was copied after the children exited");
+    int bad = verify(buf, 1);
+    if (bad >= 0)
+        errpage("children's writes reached the parent", bad);
+
+    printf(1, "XV6_TEST_OUTPUT PASS!\n");
+    exit();
+}
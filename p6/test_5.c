@@ -0,0 +1,107 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "ptentry.h"
+
+#define PGSIZE 4096
+#define PAGES_NUM 16
+#define ENTRIES_NUM 512
+
+static struct pt_entry entries[ENTRIES_NUM];
+static struct wsetstat st;
+static struct wsetinfo procs[NPROC];
+
+static int
+err(char *msg) {
+    printf(1, "XV6_TEST_OUTPUT %s\n", msg);
+    exit();
+}
+
+static int
+errpage(char *msg, int page) {
+    printf(1, "XV6_TEST_OUTPUT %s in page %d\n", msg, page);
+    exit();
+}
+
+// 1 if va has a page table entry
+static int
+mapped(char *va) {
+    int n = getpgtable(entries, ENTRIES_NUM, 0);
+    for (int i = 0; i < n; i++)
+        if (entries[i].pdx == ((uint)va >> 22) && entries[i].ptx == (((uint)va >> 12) & 0x3FF))
+            return 1;
+    return 0;
+}
+
+// Encrypted-page faults taken by this process
+static uint
+faults(void) {
+    int n = getwsetstat(&st, procs, NPROC);
+    for (int i = 0; i < n; i++)
+        if (procs[i].pid == getpid())
+            return procs[i].count.faults;
+    return err("getwsetstat did not report this process");
+}
+
+int main(void) {
+    // Room for every page this test touches, so none is encrypted
+    // under it and faults() only moves if a lazy fault is miscounted
+    if (setwsetsize(64) != 0)
+        err("setwsetsize(64) failed");
+    mapped(0);
+    faults();
+
+    char *base = sbrk(0);
+    char *buf = sbrk(PAGES_NUM * PGSIZE);
+    if (buf != base)
+        err("sbrk did not return the old break");
+    for (int i = 0; i < PAGES_NUM; i++)
+        if (mapped(buf + i * PGSIZE))
+            errpage("sbrk mapped a page before it was touched", i);
+
+    uint before = faults();
+    for (int i = 0; i < PAGES_NUM / 2; i++) {
+        if (buf[i * PGSIZE + 100] != 0)
+            errpage("lazy page is not zero-filled", i);
+        buf[i * PGSIZE + 100] = 1;
+    }
+    if (faults() != before)
+        err("a lazy fault was counted as an encrypted-page fault");
+    for (int i = 0; i < PAGES_NUM; i++)
+        if (mapped(buf + i * PGSIZE) != (i < PAGES_NUM / 2))
+            errpage("touching a page mapped the wrong pages", i);
+
+    // The kernel writes into two untouched pages
+    int fds[2];
+    char *dst = buf + (PAGES_NUM - 1) * PGSIZE - 2;
+    if (pipe(fds) != 0)
+        err("pipe failed");
+    if (write(fds[1], "lazy", 5) != 5)
+        err("write to the pipe failed");
+    if (read(fds[0], dst, 5) != 5)
+        err("read into untouched lazy pages failed");
+    if (strcmp(dst, "lazy") != 0)
+        err("read into untouched lazy pages got wrong data");
+    close(fds[0]);
+    close(fds[1]);
+
+    char *pop = sbrkflags(PGSIZE, SBRK_POPULATE);
+    if (pop != buf + PAGES_NUM * PGSIZE)
+        err("sbrkflags did not return the old break");
+    if (!mapped(pop))
+        err("SBRK_POPULATE did not map the page");
+
+    // Shrinking frees the pages; growing again starts from zero
+    if (sbrk(-(PAGES_NUM + 1) * PGSIZE) == (char *)-1 || sbrk(0) != base)
+        err("shrinking sbrk failed");
+    if (sbrk(PGSIZE) != base)
+        err("growing sbrk again failed");
+    if (mapped(base))
+        err("regrown page is mapped before it was touched");
+    if (base[100] != 0)
+        err("regrown page kept old data");
+
+    printf(1, "XV6_TEST_OUTPUT PASS!\n");
+    exit();
+}
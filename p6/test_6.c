@@ -0,0 +1,119 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "ptentry.h"
+
+#define PGSIZE 4096
+#define PAGES_NUM 48
+#define ENTRIES_NUM 512
+
+static struct pt_entry entries[ENTRIES_NUM];
+static struct wsetstat st;
+static struct wsetinfo procs[NPROC];
+
+static int
+err(char *msg) {
+    printf(1, "XV6_TEST_OUTPUT %s\n", msg);
+    exit();
+}
+
+static int
+errsize(char *msg, int size, int got) {
+    printf(1, "XV6_TEST_OUTPUT %s with size %d: got %d\n", msg, size, got);
+    exit();
+}
+
+// Working set row of this process
+static struct wsetinfo *
+self(void) {
+    int n = getwsetstat(&st, procs, NPROC);
+    for (int i = 0; i < n; i++)
+        if (procs[i].pid == getpid())
+            return &procs[i];
+    err("getwsetstat did not report this process");
+    return 0;
+}
+
+// User pages that are decrypted right now
+static int
+decrypted(void) {
+    int n = getpgtable(entries, ENTRIES_NUM, 0);
+    int count = 0;
+    for (int i = 0; i < n; i++)
+        if (entries[i].user && entries[i].present)
+            count++;
+    return count;
+}
+
+static void
+touch(char *buf, int tag) {
+    for (int i = 0; i < PAGES_NUM; i++)
+        buf[i * PGSIZE + tag] = (char)(i + tag);
+}
+
+static void
+verify(char *buf, int tag) {
+    for (int i = 0; i < PAGES_NUM; i++)
+        if (buf[i * PGSIZE + tag] != (char)(i + tag)) {
+            printf(1, "XV6_TEST_OUTPUT wrong data in page %d\n", i);
+            exit();
+        }
+}
+
+// Resize, fill the working set, and check that it holds exactly
+// size pages and nothing else is decrypted
+static void
+resize(char *buf, int size, int tag) {
+    if (setwsetsize(size) != 0)
+        errsize("setwsetsize failed", size, -1);
+    touch(buf, tag);
+    verify(buf, tag);
+    struct wsetinfo *w = self();
+    if (w->size != size)
+        errsize("wrong working set size", size, w->size);
+    if (w->adaptive)
+        errsize("working set still adaptive", size, w->adaptive);
+    if (w->resident != size)
+        errsize("working set not filled", size, w->resident);
+    int n = decrypted();
+    if (n > size)
+        errsize("more pages decrypted than the working set holds", size, n);
+}
+
+int main(void) {
+    if (setwsetsize(-1) != -1)
+        err("setwsetsize(-1) succeeded");
+    if (setwsetsize(WSETMAX + 1) != -1)
+        err("setwsetsize(WSETMAX + 1) succeeded");
+
+    char *buf = sbrkflags(PAGES_NUM * PGSIZE, SBRK_POPULATE);
+    if (buf == (char *)-1)
+        err("sbrkflags failed");
+
+    resize(buf, 16, 1);
+    resize(buf, 32, 2);
+    if (decrypted() <= 16)
+        err("growing the working set kept no more pages decrypted");
+
+    // Shrinking encrypts the dropped pages at once
+    if (setwsetsize(8) != 0)
+        err("setwsetsize(8) failed");
+    struct wsetinfo *w = self();
+    if (w->resident > 8)
+        errsize("shrink left pages in the working set", 8, w->resident);
+    if (decrypted() > 8)
+        errsize("shrink left pages decrypted", 8, decrypted());
+    verify(buf, 2);
+
+    if (st.budget != WSETBUDGET || st.used < 8)
+        err("getwsetstat reported a wrong budget");
+
+    if (setwsetsize(0) != 0)
+        err("setwsetsize(0) failed");
+    if (!self()->adaptive)
+        err("setwsetsize(0) did not make the working set adaptive");
+
+    printf(1, "XV6_TEST_OUTPUT PASS!\n");
+    exit();
+}
@@ -0,0 +1,106 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "ptentry.h"
+
+#define PGSIZE 4096
+#define PAGES_NUM 32
+#define ENTRIES_NUM 512
+
+static struct pt_entry entries[ENTRIES_NUM];
+static char scratch[PGSIZE];
+
+static int
+err(char *msg) {
+    printf(1, "XV6_TEST_OUTPUT %s\n", msg);
+    exit();
+}
+
+static int
+errpage(char *msg, int page) {
+    printf(1, "XV6_TEST_OUTPUT %s in page %d\n", msg, page);
+    exit();
+}
+
+static void
+fill(char *buf, int tag) {
+    for (int i = 0; i < PAGES_NUM; i++)
+        memset(buf + i * PGSIZE, i + tag, PGSIZE);
+}
+
+// Check pages in reverse, so the ones evicted last, which may still
+// be waiting in the queue, are faulted back first
+static void
+verify(char *buf, int tag) {
+    for (int i = PAGES_NUM - 1; i >= 0; i--)
+        for (int j = 0; j < PGSIZE; j++)
+            if (buf[i * PGSIZE + j] != (char)(i + tag))
+                errpage("wrong data", i);
+}
+
+// Index into entries of the page table entry for va, or -1
+static int
+lookup(char *va, int n) {
+    for (int i = 0; i < n; i++)
+        if (entries[i].pdx == ((uint)va >> 22) && entries[i].ptx == (((uint)va >> 12) & 0x3FF))
+            return i;
+    return -1;
+}
+
+int main(void) {
+    // Flip makes the sealed contents easy to predict
+    if (setcipher(CIPHER_FLIP) != 0)
+        err("setcipher(CIPHER_FLIP) failed");
+    if (setwsetsize(8) != 0)
+        err("setwsetsize(8) failed");
+    char *buf = sbrkflags(PAGES_NUM * PGSIZE, SBRK_POPULATE);
+    if (buf == (char *)-1)
+        err("sbrkflags failed");
+
+    // Faulting back pages that may still be queued
+    fill(buf, 1);
+    verify(buf, 1);
+
+    // A pass through the scheduler drains the queue, so every
+    // evicted page is sealed afterward
+    fill(buf, 2);
+    // Fault entries in now, so reading the table below evicts nothing
+    getpgtable(entries, ENTRIES_NUM, 0);
+    sleep(2);
+    int n = getpgtable(entries, ENTRIES_NUM, 0);
+    int sealed = 0;
+    for (int i = 0; i < PAGES_NUM; i++) {
+        int e = lookup(buf + i * PGSIZE, n);
+        if (e < 0)
+            errpage("no page table entry", i);
+        if (entries[e].present)
+            continue;
+        if (!entries[e].encrypted)
+            errpage("evicted page still queued after a reschedule", i);
+        if (dump_rawphymem(entries[e].ppage * PGSIZE, scratch) != 0)
+            err("dump_rawphymem failed");
+        for (int j = 0; j < PGSIZE; j++)
+            if (scratch[j] != (char)~(i + 2))
+                errpage("queue sealed wrong contents", i);
+        sealed++;
+    }
+    if (sealed < PAGES_NUM - 8)
+        err("too few pages were evicted");
+    verify(buf, 2);
+
+    // fork seals whatever is still queued before sharing it
+    fill(buf, 3);
+    int pid = fork();
+    if (pid < 0)
+        err("fork failed");
+    if (pid == 0) {
+        verify(buf, 3);
+        exit();
+    }
+    wait();
+    verify(buf, 3);
+
+    printf(1, "XV6_TEST_OUTPUT PASS!\n");
+    exit();
+}
@@ -56,6 +56,10 @@ void trap(struct trapframe *tf)
 		}
 		lapiceoi();
 		break;
+	case T_IRQ0 + IRQ_TLB:
+		tlbpoll();
+		lapiceoi();
+		break;
 	case T_IRQ0 + IRQ_IDE:
 		ideintr();
 		lapiceoi();
@@ -82,10 +86,23 @@ void trap(struct trapframe *tf)
 		// if full: pick victim to encrypt,
 		// else: decrypt and add to clock
 		addr = (char *)rcr2();
+		if (!cowfault(addr))
+		{
+			break;
+		}
+		// resize the working set before the page goes in, so
+		// a shrink can't evict the page that just faulted
+		pffupdate(addr);
 		if (!mdecrypt(addr))
 		{
+			prefetch(addr);
 			break;
 		};
+		// demand-zero, not a fault on an encrypted page
+		if (!lazyfault(addr))
+		{
+			break;
+		}
 
 	//PAGEBREAK: 13
 	default:
@@ -110,6 +127,12 @@ void trap(struct trapframe *tf)
 	if (myproc() && myproc()->killed && (tf->cs & 3) == DPL_USER)
 		exit();
 
+	// A process that has stopped faulting still gets its
+	// working set measured, and shrunk, once a window is up.
+	if (myproc() && myproc()->state == RUNNING &&
+		tf->trapno == T_IRQ0 + IRQ_TIMER && (tf->cs & 3) == DPL_USER)
+		pfftick();
+
 	// Force process to give up CPU on clock tick.
 	// If interrupts were on while locks held, would need to check nlock.
 	if (myproc() && myproc()->state == RUNNING &&
@@ -1,6 +1,8 @@
 struct stat;
 struct rtcdate;
 struct pt_entry;
+struct wsetstat;
+struct wsetinfo;
 
 // system calls
 int fork(void);
@@ -26,6 +28,10 @@ int sleep(int);
 int uptime(void);
 int getpgtable(struct pt_entry*, int, int);
 int dump_rawphymem(uint, char*);
+int setcipher(int);
+int setwsetsize(int);
+int getwsetstat(struct wsetstat*, struct wsetinfo*, int);
+char* sbrkflags(int, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -5,27 +5,33 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "spinlock.h"
+#include "traps.h"
 #include "elf.h"
 
 extern char data[]; // defined by kernel.ld
 pde_t *kpgdir;		// for use in scheduler()
 
-int searchwset(char *virtual_address)
+// How the ciphertext in each frame was sealed, needed to open it
+// again. Kept with the frame rather than the process because fork
+// relatives share frames sealed under one another's keys. Anything
+// copying a sealed frame copies this too.
+struct frameseal {
+	int cipher;
+	uint key[4];
+	uint nonce;
+};
+static struct frameseal frameseals[PHYSTOP / PGSIZE];
+
+// Sum of all working set sizes, held under WSETBUDGET. Every set is
+// entitled to CLOCKSIZE pages; only growth past that can be refused.
+// Also holds the counters of processes that have been freed.
+struct
 {
-	struct proc *curproc = myproc();
-	// Find a matching element
-	for (int i = 0; i < CLOCKSIZE; ++i)
-	{
-		if (curproc->clockqueue[i] != (char *)-1)
-		{
-			if (curproc->clockqueue[i] == virtual_address)
-			{
-				return 1;
-			}
-		}
-	}
-	return -1;
-}
+	struct spinlock lock;
+	int used;
+	struct wsetacct retired;
+} wsetpool;
 
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
@@ -73,6 +79,102 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
 	return &pgtab[PTX(va)];
 }
 
+// Iterator over the PTEs in use for a range of user addresses,
+// ascending or descending. A page directory entry without a page
+// table is skipped whole, so sparse or large address spaces cost
+// time in proportion to what is mapped, not to their size.
+struct ptiter
+{
+	pde_t *pgdir;
+	uint lo, hi; // range [lo, hi), page aligned
+	uint va;	 // next address to look at
+	int down;	 // go from hi down to lo
+	int done;
+};
+
+static void
+ptiterinit(struct ptiter *it, pde_t *pgdir, uint lo, uint hi, int down)
+{
+	it->pgdir = pgdir;
+	it->lo = PGROUNDDOWN(lo);
+	it->hi = PGROUNDUP(hi);
+	it->down = down;
+	it->done = it->lo >= it->hi;
+	it->va = down ? it->hi - PGSIZE : it->lo;
+}
+
+// Step it->va past the page (skip 0) or the page directory entry
+// (skip 1) it is on.
+static void
+ptstep(struct ptiter *it, int skip)
+{
+	uint base = skip ? PGADDR(PDX(it->va), 0, 0) : it->va;
+	uint next = skip ? base + NPTENTRIES * PGSIZE : base + PGSIZE;
+
+	if (it->down)
+	{
+		if (base <= it->lo)
+			it->done = 1;
+		else
+			it->va = base - PGSIZE;
+	}
+	else
+	{
+		if (next >= it->hi || next < base)
+			it->done = 1;
+		else
+			it->va = next;
+	}
+}
+
+// Return the next non-zero PTE in the range and set *va to the
+// address it maps, or return 0 when the range is exhausted.
+static pte_t *
+ptnext(struct ptiter *it, uint *va)
+{
+	pde_t *pde;
+	pte_t *pte;
+
+	while (!it->done)
+	{
+		pde = &it->pgdir[PDX(it->va)];
+		if (!(*pde & PTE_P))
+		{
+			ptstep(it, 1);
+			continue;
+		}
+		pte = &((pte_t *)P2V(PTE_ADDR(*pde)))[PTX(it->va)];
+		*va = it->va;
+		ptstep(it, 0);
+		if (*pte)
+			return pte;
+	}
+	return 0;
+}
+
+// Give the copy-on-write page behind pte a frame of its own and make
+// it writable again; once no one else maps the frame, it is simply
+// kept. The caller flushes any stale translation.
+// Returns 0 on success and -1 if out of memory.
+static int
+cowbreak(pte_t *pte)
+{
+	uint pa = PTE_ADDR(*pte);
+	char *mem;
+
+	if (krefs(P2V(pa)) > 1)
+	{
+		if ((mem = kalloc()) == 0)
+			return -1;
+		memmove(mem, P2V(pa), PGSIZE);
+		frameseals[V2P(mem) / PGSIZE] = frameseals[pa / PGSIZE];
+		*pte = V2P(mem) | PTE_FLAGS(*pte);
+		kfree(P2V(pa));
+	}
+	*pte = (*pte & ~PTE_COW) | PTE_W;
+	return 0;
+}
+
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned.
@@ -283,19 +385,17 @@ int allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 // process size.  Returns the new process size.
 int deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
+	struct ptiter it;
 	pte_t *pte;
 	uint a, pa;
 
 	if (newsz >= oldsz)
 		return oldsz;
 
-	a = PGROUNDUP(newsz);
-	for (; a < oldsz; a += PGSIZE)
+	ptiterinit(&it, pgdir, newsz, oldsz, 0);
+	while ((pte = ptnext(&it, &a)) != 0)
 	{
-		pte = walkpgdir(pgdir, (char *)a, 0);
-		if (!pte)
-			a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
-		else if ((*pte & (PTE_P | PTE_E)) != 0)
+		if ((*pte & (PTE_P | PTE_E | PTE_Q)) != 0)
 		{
 			pa = PTE_ADDR(*pte);
 			if (pa == 0)
@@ -343,41 +443,111 @@ void clearpteu(pde_t *pgdir, char *uva)
 }
 
 // Given a parent process's page table, create a copy
-// of it for a child.
+// of it for a child. The frames are shared copy-on-write:
+// writable pages lose PTE_W on both sides until a write
+// fault (or the kernel, before changing a page in place)
+// breaks the sharing with cowbreak.
 pde_t *
 copyuvm(pde_t *pgdir, uint sz)
 {
+	struct ptiter it;
 	pde_t *d;
 	pte_t *pte;
 	uint pa, i, flags;
-	char *mem;
 
 	if ((d = setupkvm()) == 0)
 		return 0;
-	for (i = 0; i < sz; i += PGSIZE)
+	ptiterinit(&it, pgdir, 0, sz, 0);
+	while ((pte = ptnext(&it, &i)) != 0)
 	{
-		if ((pte = walkpgdir(pgdir, (void *)i, 0)) == 0)
-			panic("copyuvm: pte should exist");
 		if (!(*pte & (PTE_P | PTE_E)))
 			panic("copyuvm: page not present");
+		if (*pte & PTE_W)
+			*pte = (*pte & ~PTE_W) | PTE_COW;
 		pa = PTE_ADDR(*pte);
 		flags = PTE_FLAGS(*pte);
-		if ((mem = kalloc()) == 0)
-			goto bad;
-		memmove(mem, (char *)P2V(pa), PGSIZE);
-		if (mappages(d, (void *)i, PGSIZE, V2P(mem), flags) < 0)
-		{
-			kfree(mem);
+		if (mappages(d, (void *)i, PGSIZE, pa, flags) < 0)
 			goto bad;
-		}
+		kref(P2V(pa));
 	}
+	tlbflush(pgdir, 0, PGROUNDUP(sz) / PGSIZE);
 	return d;
 
 bad:
+	tlbflush(pgdir, 0, PGROUNDUP(sz) / PGSIZE);
 	freevm(d);
 	return 0;
 }
 
+// Serve a fault on a page of the current process's heap that sbrk
+// reserved but nothing has touched yet: map a zeroed page and put
+// it in the working set. Returns 0 if va was one, -1 otherwise.
+int lazyfault(char *va)
+{
+	struct proc *p = myproc();
+	pte_t *pte;
+	char *mem;
+
+	if (p == 0 || (uint)va >= p->sz)
+		return -1;
+	va = (char *)PGROUNDDOWN((uint)va);
+	pte = walkpgdir(p->pgdir, va, 0);
+	if (pte && *pte)
+		return -1;
+	if ((mem = kalloc()) == 0)
+	{
+		cprintf("lazyfault: out of memory\n");
+		return -1;
+	}
+	memset(mem, 0, PGSIZE);
+	if (mappages(p->pgdir, va, PGSIZE, V2P(mem), PTE_W | PTE_U) < 0)
+	{
+		kfree(mem);
+		return -1;
+	}
+	return wsetinsert(va, p);
+}
+
+// Give every page of [va, va+len) that sbrk reserved but nothing
+// has touched yet a frame now, so the kernel can use the range
+// without a page fault it has no way to fail. The range must lie
+// below sz. Returns 0 on success and -1 if out of memory.
+int lazymap(uint va, uint len)
+{
+	struct proc *p = myproc();
+	pte_t *pte;
+	uint a;
+
+	for (a = PGROUNDDOWN(va); a < va + len; a += PGSIZE)
+	{
+		pte = walkpgdir(p->pgdir, (char *)a, 0);
+		if ((pte == 0 || *pte == 0) && lazyfault((char *)a) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+// Serve a write fault on a copy-on-write page of the current
+// process. Returns 0 if va was one, -1 otherwise.
+int cowfault(char *va)
+{
+	struct proc *p = myproc();
+	pte_t *pte;
+
+	if (p == 0 || va >= (char *)KERNBASE)
+		return -1;
+	pte = walkpgdir(p->pgdir, va, 0);
+	if (!pte || (*pte & (PTE_P | PTE_COW)) != (PTE_P | PTE_COW))
+		return -1;
+	if (cowbreak(pte) != 0)
+	{
+		cprintf("cowfault: out of memory\n");
+		return -1;
+	}
+	tlbflush(p->pgdir, va, 1);
+	return 0;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 // UVA -> PA
@@ -390,6 +560,8 @@ uva2ka(pde_t *pgdir, char *uva)
 	pte_t *pte;
 
 	pte = walkpgdir(pgdir, uva, 0);
+	if (pte == 0)
+		return 0;
 	//TODO: uva2ka says not present if PTE_P is 0
 	if (((*pte & PTE_P) | (*pte & PTE_E)) == 0)
 		return 0;
@@ -405,11 +577,19 @@ int copyout(pde_t *pgdir, uint va, void *p, uint len)
 {
 	char *buf, *pa0;
 	uint n, va0;
+	pte_t *pte;
 
 	buf = (char *)p;
 	while (len > 0)
 	{
 		va0 = (uint)PGROUNDDOWN(va);
+		pte = walkpgdir(pgdir, (char *)va0, 0);
+		if (pte && (*pte & PTE_COW))
+		{
+			if (cowbreak(pte) != 0)
+				return -1;
+			tlbflush(pgdir, (char *)va0, 1);
+		}
 		//TODO: what happens if you copyout to an encrypted page?
 		pa0 = uva2ka(pgdir, (char *)va0);
 		if (pa0 == 0)
@@ -427,6 +607,384 @@ int copyout(pde_t *pgdir, uint va, void *p, uint len)
 	return 0;
 }
 
+// Do any TLB shootdown another CPU has asked of this one.
+// Remote requests always flush the whole TLB.
+void tlbpoll(void)
+{
+	struct cpu *c;
+	uint req;
+
+	pushcli();
+	c = mycpu();
+	req = c->tlbreq;
+	if (req != c->tlback)
+	{
+		lcr3(rcr3());
+		c->tlback = req;
+	}
+	popcli();
+}
+
+// Invalidate the translations of npages pages from va in pgdir, on
+// this CPU with invlpg (or a full flush past TLBFLUSHMAX pages) and
+// on every other CPU running on pgdir with a shootdown IPI. Waits
+// for those CPUs, serving shootdowns aimed at this one meanwhile,
+// so the caller must not hold a spinlock.
+void tlbflush(pde_t *pgdir, char *va, uint npages)
+{
+	struct cpu *me, *c;
+	struct proc *rp;
+	uint seq[NCPU];
+	int i;
+
+	pushcli();
+	me = mycpu();
+	if (rcr3() == V2P(pgdir))
+	{
+		if (npages > TLBFLUSHMAX)
+			lcr3(V2P(pgdir));
+		else
+			for (i = 0; i < npages; i++)
+				invlpg(va + i * PGSIZE);
+	}
+
+	// The PTE stores must be visible before we look for CPUs
+	// that might still cache them.
+	__sync_synchronize();
+	for (i = 0; i < ncpu; i++)
+	{
+		c = &cpus[i];
+		seq[i] = 0;
+		// c->proc changes under us without a lock; read it once.
+		rp = *(struct proc *volatile *)&c->proc;
+		if (c == me || rp == 0 || rp->pgdir != pgdir)
+			continue;
+		seq[i] = __sync_add_and_fetch(&c->tlbreq, 1);
+		lapicipi(c->apicid, T_IRQ0 + IRQ_TLB);
+	}
+	for (i = 0; i < ncpu; i++)
+		while (seq[i] && (int)(cpus[i].tlback - seq[i]) < 0)
+			tlbpoll();
+	popcli();
+}
+
+// Page ciphers. Each XORs a keystream over the page, so running
+// crypt again with the same key, va and nonce undoes it; sealing
+// draws a fresh nonce every time (see seal and unseal below).
+// crypt works on the kernel mapping of the frame; va and nonce
+// only seed the keystream.
+struct cipher {
+	int keyed; // output depends on the process key
+	void (*crypt)(uint *key, uint va, uint nonce, uint *page);
+};
+
+// All-ones keystream: complements the page a word at a time,
+// bit-for-bit what the old per-byte flip produced.
+static void
+flipcrypt(uint *key, uint va, uint nonce, uint *page)
+{
+	uint *end = page + PGSIZE / sizeof(uint);
+
+	for (; page < end; page += 4)
+	{
+		page[0] = ~page[0];
+		page[1] = ~page[1];
+		page[2] = ~page[2];
+		page[3] = ~page[3];
+	}
+}
+
+#define XTEADELTA 0x9E3779B9
+#define XTEAROUNDS 32
+
+// XTEA in counter mode. Block i of the page at va is XORed with
+// XTEA(key, va|i, nonce); va is page aligned and i < PGSIZE/8, and
+// every sealing takes a new nonce, so a key never reuses keystream
+// until the 32-bit nonce counter wraps.
+static void
+xteacrypt(uint *key, uint va, uint nonce, uint *page)
+{
+	uint i, r, v0, v1, sum;
+
+	for (i = 0; i < PGSIZE / 8; i++)
+	{
+		v0 = va | i;
+		v1 = nonce;
+		sum = 0;
+		for (r = 0; r < XTEAROUNDS; r++)
+		{
+			v0 += (((v1 << 4) ^ (v1 >> 5)) + v1) ^ (sum + key[sum & 3]);
+			sum += XTEADELTA;
+			v1 += (((v0 << 4) ^ (v0 >> 5)) + v0) ^ (sum + key[(sum >> 11) & 3]);
+		}
+		page[2 * i] ^= v0;
+		page[2 * i + 1] ^= v1;
+	}
+}
+
+static struct cipher ciphers[NCIPHER] = {
+	[CIPHER_FLIP] {0, flipcrypt},
+	[CIPHER_XTEA] {1, xteacrypt},
+};
+
+static uint nextnonce;
+
+// Encrypt the user page at va through its kernel address kva with
+// cipher c under key and a nonce no earlier sealing has used.
+static void
+seal(int c, uint *key, uint va, char *kva)
+{
+	struct frameseal *fs = &frameseals[V2P(kva) / PGSIZE];
+
+	fs->cipher = c;
+	memmove(fs->key, key, sizeof(fs->key));
+	fs->nonce = __sync_add_and_fetch(&nextnonce, 1);
+	ciphers[c].crypt(key, va, fs->nonce, (uint *)kva);
+}
+
+// Decrypt what seal left at kva, whoever sealed it.
+static void
+unseal(uint va, char *kva)
+{
+	struct frameseal *fs = &frameseals[V2P(kva) / PGSIZE];
+
+	ciphers[fs->cipher].crypt(fs->key, va, fs->nonce, (uint *)kva);
+}
+
+// Whether kva was sealed the way p would seal it now.
+static int
+sealedby(char *kva, struct proc *p)
+{
+	struct frameseal *fs = &frameseals[V2P(kva) / PGSIZE];
+
+	return fs->cipher == p->cipher &&
+		   (!ciphers[fs->cipher].keyed || memcmp(fs->key, p->key, sizeof(p->key)) == 0);
+}
+
+// Pick a fresh page cipher key for p. There is no hardware RNG
+// to lean on, so stir the TSC, pid and a running counter through
+// a multiply-xorshift finalizer.
+void genkey(struct proc *p)
+{
+	static uint seed; // unlocked; a lost update only costs entropy
+	uint x;
+
+	for (int i = 0; i < 4; i++)
+	{
+		seed += XTEADELTA;
+		x = seed ^ (uint)rdtsc() ^ (p->pid << 16);
+		x ^= x >> 16;
+		x *= 0x85EBCA6B;
+		x ^= x >> 13;
+		x *= 0xC2B2AE35;
+		x ^= x >> 16;
+		p->key[i] = x;
+	}
+}
+
+// Re-encrypt the encrypted pages of p that are not sealed with its
+// current cipher and key. Frames still shared copy-on-write get
+// copies of their own first, so running out of memory leaves every
+// page as it was. Returns 0 on success and -1 if out of memory.
+static int
+recryptuvm(struct proc *p)
+{
+	struct ptiter it;
+	pte_t *pte;
+	char *kva;
+	uint va;
+
+	ptiterinit(&it, p->pgdir, 0, p->sz, 0);
+	while ((pte = ptnext(&it, &va)) != 0)
+	{
+		if (!(*pte & PTE_E) || sealedby(P2V(PTE_ADDR(*pte)), p))
+			continue;
+		if ((*pte & PTE_COW) && cowbreak(pte) != 0)
+			return -1;
+	}
+	ptiterinit(&it, p->pgdir, 0, p->sz, 0);
+	while ((pte = ptnext(&it, &va)) != 0)
+	{
+		if (!(*pte & PTE_E))
+			continue;
+		kva = P2V(PTE_ADDR(*pte));
+		if (sealedby(kva, p))
+			continue;
+		unseal(va, kva);
+		seal(p->cipher, p->key, va, kva);
+	}
+	return 0;
+}
+
+// Switch the calling process to cipher c, re-sealing its
+// encrypted pages. Returns 0 on success, -1 for an unknown
+// cipher or if out of memory.
+int setcipher(int c)
+{
+	struct proc *p = myproc();
+	int old;
+
+	if (c < 0 || c >= NCIPHER)
+		return -1;
+	encqflush(p, 1);
+	old = p->cipher;
+	p->cipher = c;
+	if (recryptuvm(p) != 0)
+	{
+		p->cipher = old;
+		return -1;
+	}
+	return 0;
+}
+
+// Background encryption. A working set victim is unmapped at once
+// and queued still in plaintext, marked PTE_Q, on the queue of the
+// CPU that evicted it; each CPU encrypts its own queue from the
+// scheduler loop, between processes. A fault on a page that is still
+// queued just maps it back. The lock of the queue a page's job is on
+// guards its PTE_Q transitions; jobq records which queue that is.
+struct encjob
+{
+	struct proc *p; // 0 once cancelled
+	pde_t *pgdir;
+	char *va;
+	uint pa;
+	int cipher;
+	uint key[4];
+};
+
+struct encq
+{
+	struct spinlock lock;
+	uint head, tail; // pending jobs are jobs[head..tail) mod NENCQ
+	struct encjob jobs[NENCQ];
+} encqs[NCPU];
+
+// Queue holding the job of each frame marked PTE_Q. Only the owning
+// process queues or cancels its pages, so this is stable while it
+// looks it up.
+static uchar jobq[PHYSTOP / PGSIZE];
+
+void encqinit(void)
+{
+	for (int i = 0; i < NCPU; i++)
+		initlock(&encqs[i].lock, "encq");
+}
+
+// Encrypt j's page if it is still waiting for it.
+// Caller holds the queue lock.
+static void
+encjobrun(struct encjob *j)
+{
+	pte_t *pte = walkpgdir(j->pgdir, j->va, 0);
+
+	if (pte && (*pte & PTE_Q) && PTE_ADDR(*pte) == j->pa)
+	{
+		seal(j->cipher, j->key, (uint)j->va, P2V(j->pa));
+		*pte = (*pte & ~PTE_Q) | PTE_E;
+	}
+	j->p = 0;
+}
+
+// Unmap p's working set victim va and queue it for encryption on
+// this CPU, or encrypt it right here if the queue is full.
+// Returns 0 on success and -1 on failure
+static int
+evict(struct proc *p, char *va)
+{
+	pte_t *pte = walkpgdir(p->pgdir, va, 0);
+	struct encjob *j;
+	struct encq *q;
+	int cpu;
+
+	p->wacct.n.evictions++;
+	if (!pte || !(*pte & PTE_P))
+		return mencrypt(va, 1);
+	// The worker encrypts in place, so take the page private first
+	if ((*pte & PTE_COW) && cowbreak(pte) != 0)
+		return -1;
+	pushcli();
+	cpu = cpuid();
+	popcli();
+	q = &encqs[cpu];
+	acquire(&q->lock);
+	if (q->tail - q->head == NENCQ)
+	{
+		release(&q->lock);
+		return mencrypt(va, 1);
+	}
+	j = &q->jobs[q->tail++ % NENCQ];
+	j->p = p;
+	j->pgdir = p->pgdir;
+	j->va = va;
+	j->pa = PTE_ADDR(*pte);
+	j->cipher = p->cipher;
+	memmove(j->key, p->key, sizeof(j->key));
+	jobq[j->pa / PGSIZE] = cpu;
+	*pte = (*pte & ~(PTE_P | PTE_A)) | PTE_Q;
+	release(&q->lock);
+
+	tlbflush(p->pgdir, va, 1);
+	return 0;
+}
+
+// Map back a page of p whose encryption is pending. Returns 1 if it
+// was still plaintext, 0 if it got encrypted first.
+static int
+encqcancel(struct proc *p, pte_t *pte)
+{
+	struct encq *q = &encqs[jobq[PTE_ADDR(*pte) / PGSIZE]];
+	int plain;
+
+	acquire(&q->lock);
+	plain = (*pte & PTE_Q) != 0;
+	if (plain)
+		*pte = (*pte & ~PTE_Q) | PTE_P;
+	release(&q->lock);
+	return plain;
+}
+
+// Settle every page p has queued: encrypt them now, or with
+// encrypt 0 just drop the jobs because the address space is
+// about to be freed.
+void encqflush(struct proc *p, int encrypt)
+{
+	struct encq *q;
+	struct encjob *j;
+
+	for (q = encqs; q < &encqs[ncpu]; q++)
+	{
+		acquire(&q->lock);
+		for (uint i = q->head; i != q->tail; i++)
+		{
+			j = &q->jobs[i % NENCQ];
+			if (j->p != p)
+				continue;
+			if (encrypt)
+				encjobrun(j);
+			else
+				j->p = 0;
+		}
+		release(&q->lock);
+	}
+}
+
+// Encrypt up to NENCBATCH pages queued on this cpu.
+void encqwork(int cpu)
+{
+	struct encq *q = &encqs[cpu];
+	struct encjob *j;
+
+	acquire(&q->lock);
+	for (int n = 0; n < NENCBATCH && q->head != q->tail; n++)
+	{
+		j = &q->jobs[q->head++ % NENCQ];
+		if (j->p)
+			encjobrun(j);
+	}
+	release(&q->lock);
+}
+
 //returns 0 on success
 int mdecrypt(char *virtual_addr)
 {
@@ -434,6 +992,8 @@ int mdecrypt(char *virtual_addr)
 	//the given pointer is a virtual address in this pid's userspace
 	struct proc *p = myproc();
 	pde_t *mypd = p->pgdir;
+	unsigned long long t0 = rdtsc();
+	int r;
 
 	if (virtual_addr >= (char *)KERNBASE)
 	{
@@ -441,24 +1001,29 @@ int mdecrypt(char *virtual_addr)
 	}
 	//set the present bit to true and encrypt bit to false
 	pte_t *pte = walkpgdir(mypd, virtual_addr, 0);
-	if (!pte || (*pte == 0))
+	if (!pte || !(*pte & (PTE_E | PTE_Q)))
 	{
 		return -1;
 	}
 
-	*pte = *pte & ~PTE_E;
-	*pte = *pte | PTE_P;
-
+	// No TLB flush: x86 never caches a not-present translation
 	virtual_addr = (char *)PGROUNDDOWN((uint)virtual_addr);
-
-	char *slider = virtual_addr;
-	for (int offset = 0; offset < PGSIZE; offset++)
+	if (!(*pte & PTE_Q) || !encqcancel(p, pte))
 	{
-		*slider = ~*slider;
-		slider++;
+		// Decrypt a frame still shared with fork relatives in a copy
+		if ((*pte & PTE_COW) && cowbreak(pte) != 0)
+		{
+			return -1;
+		}
+		unseal((uint)virtual_addr, P2V(PTE_ADDR(*pte)));
+		*pte = *pte & ~PTE_E;
+		*pte = *pte | PTE_P;
+		p->wacct.n.decrypts++;
 	}
 
-	return wsetinsert(virtual_addr, p);
+	r = wsetinsert(virtual_addr, p);
+	p->wacct.cdecrypt += rdtsc() - t0;
+	return r;
 }
 
 int mencrypt(char *virtual_addr, int len)
@@ -466,46 +1031,69 @@ int mencrypt(char *virtual_addr, int len)
 	//the given pointer is a virtual address in this pid's userspace
 	struct proc *p = myproc();
 	pde_t *mypd = p->pgdir;
+	unsigned long long t0 = rdtsc();
+	struct ptiter it;
+	pte_t *mypte;
+	uint va, end;
 
 	virtual_addr = (char *)PGROUNDDOWN((uint)virtual_addr);
+	if (len < 0)
+		len = 0;
+	if (len > (KERNBASE - (uint)virtual_addr) / PGSIZE)
+	{
+		cprintf("mencrypt: Could not access address\n");
+		return -1;
+	}
+	end = (uint)virtual_addr + len * PGSIZE;
 
 	//error checking first. all or nothing.
-	char *slider = virtual_addr;
-	for (int i = 0; i < len; i++)
+	//every page in range must be a mapped or encrypted user page
+	uint expect = (uint)virtual_addr;
+	ptiterinit(&it, mypd, expect, end, 0);
+	while ((mypte = ptnext(&it, &va)) != 0)
+	{
+		if (va != expect || !(*mypte & PTE_U) || !(*mypte & (PTE_P | PTE_E)))
+			break;
+		expect += PGSIZE;
+	}
+	if (expect != end)
+	{
+		cprintf("mencrypt: Could not access address\n");
+		return -1;
+	}
+
+	//a page about to be encrypted in place needs its own frame.
+	//if we run out of memory partway, the pages already copied
+	//are still correct, but their stale read-only translations
+	//must go before we bail out
+	ptiterinit(&it, mypd, (uint)virtual_addr, end, 0);
+	while ((mypte = ptnext(&it, &va)) != 0)
 	{
-		//check page table for each translation first
-		char *kvp = uva2ka(mypd, slider);
-		if (!kvp)
+		if (!(*mypte & PTE_E) && (*mypte & PTE_COW) && cowbreak(mypte) != 0)
 		{
-			cprintf("mencrypt: Could not access address\n");
+			tlbflush(mypd, virtual_addr, (va - (uint)virtual_addr) / PGSIZE);
+			cprintf("mencrypt: out of memory\n");
 			return -1;
 		}
-		slider = slider + PGSIZE;
 	}
 
 	//encrypt stage. Have to do this before setting flag
 	//or else we'll page fault
-	slider = virtual_addr;
-	for (int i = 0; i < len; i++)
+	ptiterinit(&it, mypd, (uint)virtual_addr, end, 0);
+	while ((mypte = ptnext(&it, &va)) != 0)
 	{
-		//we get the page table entry that corresponds to this VA
-		pte_t *mypte = walkpgdir(mypd, slider, 0);
 		if (*mypte & PTE_E)
 		{ //already encrypted
-			slider += PGSIZE;
 			continue;
 		}
-		for (int offset = 0; offset < PGSIZE; offset++)
-		{
-			*slider = ~*slider;
-			slider++;
-		}
+		seal(p->cipher, p->key, va, P2V(PTE_ADDR(*mypte)));
 		*mypte = *mypte & ~PTE_P;
 		*mypte = *mypte | PTE_E;
 		*mypte = *mypte & ~PTE_A;
 	}
 
-	switchuvm(myproc());
+	tlbflush(mypd, virtual_addr, len);
+	p->wacct.cencrypt += rdtsc() - t0;
 	return 0;
 }
 
@@ -518,50 +1106,30 @@ int getpgtable(struct pt_entry *entries, int num, int wsetOnly)
 	}
 
 	struct proc *curproc = myproc();
+	struct ptiter it;
+	pte_t *pte;
+	uint i;
 	int index = 0;
 
-	for (void *i = (void *)PGROUNDDOWN(((int)curproc->sz)); i >= 0; i -= PGSIZE)
+	//walk the page table from the top of memory down and read the
+	//entries in use; those contain the physical page number + flags
+	ptiterinit(&it, curproc->pgdir, 0, PGROUNDDOWN(curproc->sz) + PGSIZE, 1);
+	while (index < num && (pte = ptnext(&it, &i)) != 0)
 	{
-		//walk through the page table and read the entries
-		//Those entries contain the physical page number + flags
-		pte_t *pte = walkpgdir(curproc->pgdir, i, 0);
-
-		if (wsetOnly == 1)
-		{
-			// Page is allocated and exists in working set
-			if (*pte && (searchwset(i) != -1))
-			{
-				entries[index].pdx = PDX(i);
-				entries[index].ptx = PTX(i);
-				entries[index].ppage = *pte >> 12;
-				entries[index].present = (*pte & PTE_P) ? 1 : 0;
-				entries[index].writable = (*pte & PTE_W) ? 1 : 0;
-				entries[index].user = (*pte & PTE_U) ? 1 : 0;
-				entries[index].encrypted = (*pte & PTE_E) ? 1 : 0;
-				entries[index].ref = (*pte & PTE_A) ? 1 : 0;
-				index++;
-			}
-		}
-		else
-		{
-			// Page is allocated
-			if (*pte)
-			{
-				entries[index].pdx = PDX(i);
-				entries[index].ptx = PTX(i);
-				entries[index].ppage = *pte >> 12;
-				entries[index].present = (*pte & PTE_P) ? 1 : 0;
-				entries[index].writable = (*pte & PTE_W) ? 1 : 0;
-				entries[index].user = (*pte & PTE_U) ? 1 : 0;
-				entries[index].encrypted = (*pte & PTE_E) ? 1 : 0;
-				entries[index].ref = (*pte & PTE_A) ? 1 : 0;
-				index++;
-			}
-		}
-		if (i == 0 || index >= num)
+		// Page must exist in working set
+		if (wsetOnly == 1 && searchwset((char *)i) == -1)
 		{
-			break;
+			continue;
 		}
+		entries[index].pdx = PDX(i);
+		entries[index].ptx = PTX(i);
+		entries[index].ppage = *pte >> 12;
+		entries[index].present = (*pte & PTE_P) ? 1 : 0;
+		entries[index].writable = (*pte & PTE_W) ? 1 : 0;
+		entries[index].user = (*pte & PTE_U) ? 1 : 0;
+		entries[index].encrypted = (*pte & PTE_E) ? 1 : 0;
+		entries[index].ref = (*pte & PTE_A) ? 1 : 0;
+		index++;
 	}
 	//index is the number of ptes copied
 	return index;
@@ -578,82 +1146,426 @@ int dump_rawphymem(uint physical_addr, char *buffer)
 	return 0;
 }
 
-// Insert a page into the working set (queue)
+#define VPN(va) ((uint)(va) >> PTXSHIFT)
+
+static int
+wsethash(char *va)
+{
+	uint vpn = VPN(va);
+
+	return (vpn ^ (vpn >> 9)) & (WSETHASH - 1);
+}
+
+// Hash slot holding va's page, or the empty slot where it would go.
+// The table is never more than half full, so the probe ends.
+static int
+wsetprobe(struct wset *ws, char *va)
+{
+	int h;
+
+	for (h = wsethash(va); ws->hash[h] >= 0; h = (h + 1) & (WSETHASH - 1))
+		if (VPN(ws->ring[ws->hash[h]]) == VPN(va))
+			break;
+	return h;
+}
+
+// Empty hash slot h, shifting later entries of its probe run back
+// so lookups never need tombstones.
+static void
+wsetunhash(struct wset *ws, int h)
+{
+	int j, k;
+
+	for (j = (h + 1) & (WSETHASH - 1); ws->hash[j] >= 0; j = (j + 1) & (WSETHASH - 1))
+	{
+		// The entry at j may fill the hole unless its home k lies
+		// cyclically in (h, j].
+		k = wsethash(ws->ring[ws->hash[j]]);
+		if (h < j ? (k <= h || k > j) : (k <= h && k > j))
+		{
+			ws->hash[h] = ws->hash[j];
+			h = j;
+		}
+	}
+	ws->hash[h] = -1;
+}
+
+static void
+wsetadd(struct wset *ws, int slot, char *va)
+{
+	ws->ring[slot] = va;
+	ws->hash[wsetprobe(ws, va)] = slot;
+	ws->count++;
+}
+
+// Drop the page found at hash slot h from the working set.
+static void
+wsetremove(struct wset *ws, int h)
+{
+	int slot = ws->hash[h];
+
+	wsetunhash(ws, h);
+	ws->ring[slot] = WSETEMPTY;
+	ws->free[ws->nfree++] = slot;
+	ws->count--;
+}
+
+// Rebuild the free stack so the lowest empty slot is used first.
+static void
+wsetrefill(struct wset *ws)
+{
+	ws->nfree = 0;
+	for (int i = ws->size - 1; i >= 0; i--)
+		if (ws->ring[i] == WSETEMPTY)
+			ws->free[ws->nfree++] = i;
+}
+
+// Empty ws, keeping its size.
+void wsetinit(struct wset *ws)
+{
+	for (int i = 0; i < WSETMAX; i++)
+		ws->ring[i] = WSETEMPTY;
+	for (int i = 0; i < WSETHASH; i++)
+		ws->hash[i] = -1;
+	ws->count = 0;
+	ws->hand = -1;
+	wsetrefill(ws);
+}
+
+// Returns 1 if the page holding virtual_address is in the working set
+// and -1 otherwise
+int searchwset(char *virtual_address)
+{
+	struct wset *ws = myproc()->wset;
+
+	return ws->hash[wsetprobe(ws, virtual_address)] >= 0 ? 1 : -1;
+}
+
+// Insert a page into the working set
 // Returns 0 on success and -1 on failure
-int wsetinsert(char *virtual_addr, struct proc *p)
+static int
+wsetclock(char *virtual_addr, struct proc *p)
 {
+	struct wset *ws = p->wset;
+	pte_t *pte;
+	int h;
+
+	if (ws->hash[wsetprobe(ws, virtual_addr)] >= 0)
+		return 0;
+	p->wacct.n.inserts++;
+
+	// Empty space exists in the ring
+	if (ws->nfree > 0)
+	{
+		wsetadd(ws, ws->free[--ws->nfree], virtual_addr);
+		return 0;
+	}
+
 	while (1)
 	{
 		// Move the hand
-		p->clockhand = (p->clockhand + 1) % CLOCKSIZE;
-		char *uva = (char *)PGROUNDDOWN((uint)p->clockqueue[p->clockhand]);
-		pte_t *pte = walkpgdir(p->pgdir, uva, 0);
+		ws->hand = (ws->hand + 1) % ws->size;
+		pte = walkpgdir(p->pgdir, ws->ring[ws->hand], 0);
+		p->wacct.n.sweeps++;
 
-		// Empty space exists in queue
-		if (p->clockqueue[p->clockhand] == (char *)-1)
-		{
-			p->clockqueue[p->clockhand] = virtual_addr;
-			return 0;
-		}
 		// If working set is full, evict page with ref bit not set
-		else if (!((*pte) & PTE_A))
+		if (!((*pte) & PTE_A))
 		{
 			// Encrypt evicted page
-			if (mencrypt(p->clockqueue[p->clockhand], 1) != 0)
+			if (evict(p, ws->ring[ws->hand]) != 0)
 			{
 				return -1;
 			}
 			// Replace with new page
-			p->clockqueue[p->clockhand] = virtual_addr;
+			h = wsetprobe(ws, ws->ring[ws->hand]);
+			wsetunhash(ws, h);
+			ws->count--;
+			wsetadd(ws, ws->hand, virtual_addr);
 			return 0;
 		}
 		// Unset ref bit of page observing and move to next page
 		else
 		{
+			// A cached translation would let the page be used
+			// again without the hardware setting PTE_A
 			*pte = *pte & ~PTE_A;
+			tlbflush(p->pgdir, ws->ring[ws->hand], 1);
+			p->wacct.n.refclears++;
 		}
 	}
 }
 
-// Delete a page from the working set (queue)
-// Returns 0 on success and -1 on failure
+int wsetinsert(char *virtual_addr, struct proc *p)
+{
+	unsigned long long t0 = rdtsc();
+	int r = wsetclock(virtual_addr, p);
+
+	p->wacct.cinsert += rdtsc() - t0;
+	return r;
+}
+
+// Delete a page from the working set
+// Returns 0 on success and -1 if it was not there
 int wsetdelete(char *virtual_address)
 {
-	struct proc *curproc = myproc();
-	int tail = curproc->clockhand;
-	int found = -1;
+	struct wset *ws = myproc()->wset;
+	int h = wsetprobe(ws, virtual_address);
+
+	if (ws->hash[h] < 0)
+		return -1;
+	wsetremove(ws, h);
+	return 0;
+}
 
-	// Search for the location to delete
-	for (int i = 0; i < CLOCKSIZE; ++i)
+// Clear the working set
+void clearwset(void)
+{
+	wsetinit(myproc()->wset);
+}
+
+// Sequential-fault readahead, called after the fault on va has been
+// served. A fault on the page just past the previous run (including
+// what was decrypted ahead for it) doubles the window; any other
+// fault closes it. The page that just faulted is marked referenced
+// and the window stays within half the working set, so the hand
+// can't come round to it twice and readahead can't push it out.
+// Only user pages are read ahead; the stack guard page ends a run.
+void prefetch(char *va)
+{
+	struct proc *p = myproc();
+	uint vpn = VPN(va);
+	char *a;
+	pte_t *pte;
+	int k;
+
+	if ((pte = walkpgdir(p->pgdir, va, 0)) != 0)
+		*pte |= PTE_A;
+	if (vpn == p->pfnext)
+		p->pfwindow = p->pfwindow ? 2 * p->pfwindow : 1;
+	else
+		p->pfwindow = 0;
+	if (p->pfwindow > p->wset->size / 2)
+		p->pfwindow = p->wset->size / 2;
+
+	for (k = 0; k < p->pfwindow; k++)
 	{
-		if (curproc->clockqueue[(curproc->clockhand + i) % CLOCKSIZE] == virtual_address)
-		{
-			found = (curproc->clockhand + i) % CLOCKSIZE;
-		}
+		a = (char *)((vpn + 1 + k) << PTXSHIFT);
+		if ((uint)a >= p->sz)
+			break;
+		pte = walkpgdir(p->pgdir, a, 0);
+		if (!pte || !(*pte & PTE_U) || !(*pte & (PTE_P | PTE_E | PTE_Q)))
+			break;
+		if ((*pte & (PTE_E | PTE_Q)) && mdecrypt(a) != 0)
+			break;
 	}
+	p->pfnext = vpn + 1 + k;
+}
+
+void wsetpoolinit(void)
+{
+	initlock(&wsetpool.lock, "wsetpool");
+}
 
-	// If location is found
-	if (found != -1)
+// Move a working set's charge against the pool from old to new pages
+// and return the size granted. Shrinking always succeeds; growth
+// past CLOCKSIZE gets what the budget has left when partial is set,
+// and nothing otherwise. force charges new regardless.
+static int
+wsetcharge(int old, int new, int partial, int force)
+{
+	int avail;
+
+	acquire(&wsetpool.lock);
+	if (new > old && new > CLOCKSIZE && !force)
 	{
-		// Delete by shifting all pages after it in queue left one
-		for (int i = found; i != tail; i = (i + 1) % CLOCKSIZE)
+		avail = WSETBUDGET - wsetpool.used;
+		if (old < CLOCKSIZE)
+			avail += CLOCKSIZE - old;
+		if (new - old > avail)
+			new = partial && avail > 0 ? old + avail : old;
+	}
+	wsetpool.used += new - old;
+	release(&wsetpool.lock);
+	return new;
+}
+
+// Allocate an empty working set of CLOCKSIZE pages.
+struct wset *
+wsetalloc(void)
+{
+	struct wset *ws;
+
+	if ((ws = (struct wset *)kalloc()) == 0)
+		return 0;
+	ws->size = wsetcharge(0, CLOCKSIZE, 0, 1);
+	wsetinit(ws);
+	return ws;
+}
+
+// Make dst a copy of src. fork uses this, so the child is charged
+// for src's size even if that overshoots the budget for a while.
+void wsetcopy(struct wset *dst, struct wset *src)
+{
+	wsetcharge(dst->size, src->size, 0, 1);
+	memmove(dst, src, sizeof(struct wset));
+}
+
+void wsetfree(struct wset *ws)
+{
+	wsetcharge(ws->size, 0, 0, 1);
+	kfree((char *)ws);
+}
+
+// Resize p's working set, which must be the current process's,
+// toward n pages, encrypting whatever sits in the slots being
+// dropped. Returns the new size.
+static int
+wsetresize(struct proc *p, int n, int partial)
+{
+	struct wset *ws = p->wset;
+
+	if (n < ws->size)
+	{
+		for (int i = n; i < ws->size; i++)
 		{
-			curproc->clockqueue[i] = curproc->clockqueue[(i + 1) % CLOCKSIZE];
+			if (ws->ring[i] == WSETEMPTY)
+				continue;
+			if (evict(p, ws->ring[i]) != 0)
+				return ws->size;
+			wsetremove(ws, wsetprobe(ws, ws->ring[i]));
 		}
+		if (ws->hand >= n)
+			ws->hand = -1;
+	}
+	ws->size = wsetcharge(ws->size, n, partial, 0);
+	wsetrefill(ws);
+	return ws->size;
+}
+
+// Page fault frequency control. Once a window of PFFWINDOW ticks
+// has passed, the fault rate over it decides whether the working
+// set of p doubles (within the budget), halves (down to CLOCKSIZE)
+// or stays.
+static void
+pffwindow(struct proc *p)
+{
+	uint elapsed = ticks - p->pffstart;
+	int size = p->wset->size;
+
+	if (elapsed < PFFWINDOW)
+		return;
+	p->pffrate = p->pffaults * PFFWINDOW / elapsed;
+	p->pffaults = 0;
+	p->pffstart = ticks;
+	if (!p->pffauto)
+		return;
+	if (p->pffrate > PFFHIGH && size < WSETMAX)
+		wsetresize(p, size * 2 < WSETMAX ? size * 2 : WSETMAX, 1);
+	else if (p->pffrate < PFFLOW && size > CLOCKSIZE)
+		wsetresize(p, size / 2 > CLOCKSIZE ? size / 2 : CLOCKSIZE, 1);
+}
+
+// Count a fault of the current process at va if it is on an
+// encrypted (or queued) page, before the fault is served.
+void pffupdate(char *va)
+{
+	struct proc *p = myproc();
+	pte_t *pte;
 
-		// Clear tail address, shift clock hand to be one before it (for next add)
-		curproc->clockqueue[tail] = (char *)-1;
-		curproc->clockhand = curproc->clockhand == 0 ? CLOCKSIZE - 1 : curproc->clockhand - 1;
+	if (p == 0 || va >= (char *)KERNBASE)
+		return;
+	pte = walkpgdir(p->pgdir, va, 0);
+	if (!pte || !(*pte & (PTE_E | PTE_Q)))
+		return;
+	p->wacct.n.faults++;
+	p->pffaults++;
+	pffwindow(p);
+}
+
+// Close the current process's window from the timer, so one that
+// has stopped faulting is still measured and shrunk.
+void pfftick(void)
+{
+	pffwindow(myproc());
+}
+
+// Pin the calling process's working set at n pages, or hand its
+// size back to the page fault frequency controller if n is 0.
+// Returns 0 on success and -1 if n is out of range or over budget.
+int setwsetsize(int n)
+{
+	struct proc *p = myproc();
+
+	if (n < 0 || n > WSETMAX)
+		return -1;
+	if (n == 0)
+	{
+		p->pffauto = 1;
 		return 0;
 	}
-	return -1;
+	if (wsetresize(p, n, 0) != n)
+		return -1;
+	p->pffauto = 0;
+	return 0;
 }
 
-// Clear the working set (queue)
-void clearwset(void)
+// dst += src
+void wsetacctadd(struct wsetacct *dst, struct wsetacct *src)
 {
-	struct proc *curproc = myproc();
-	for (int i = 0; i < CLOCKSIZE; ++i)
-		curproc->clockqueue[i] = (char *)-1;
-	curproc->clockhand = -1;
+	dst->n.faults += src->n.faults;
+	dst->n.decrypts += src->n.decrypts;
+	dst->n.evictions += src->n.evictions;
+	dst->n.refclears += src->n.refclears;
+	dst->n.inserts += src->n.inserts;
+	dst->n.sweeps += src->n.sweeps;
+	dst->cdecrypt += src->cdecrypt;
+	dst->cencrypt += src->cencrypt;
+	dst->cinsert += src->cinsert;
+}
+
+// Copy a's counters out for user space, cycles as kilocycles.
+void wsetacctreport(struct wsetacct *a, struct wsetcount *c)
+{
+	*c = a->n;
+	c->kcdecrypt = a->cdecrypt >> 10;
+	c->kcencrypt = a->cencrypt >> 10;
+	c->kcinsert = a->cinsert >> 10;
+}
+
+// Fold a freed process's counters into the global totals.
+void wsetretire(struct wsetacct *a)
+{
+	acquire(&wsetpool.lock);
+	wsetacctadd(&wsetpool.retired, a);
+	release(&wsetpool.lock);
+}
+
+// Report the working set budget and global counters in *st and the
+// working set of up to num processes in procs.
+// Both are filled in kernel memory first and written out to the user
+// buffers only once no lock is held, since that write may fault.
+// Returns the number of entries filled.
+int getwsetstat(struct wsetstat *st, struct wsetinfo *procs, int num)
+{
+	struct wsetacct total;
+	struct wsetstat kst;
+	struct wsetinfo *kprocs;
+	int n;
+
+	if (NPROC * sizeof(*kprocs) > PGSIZE)
+		panic("getwsetstat");
+	if ((kprocs = (struct wsetinfo *)kalloc()) == 0)
+		return -1;
+	memset(&total, 0, sizeof(total));
+	n = procwsetinfo(kprocs, num, &total);
+	acquire(&wsetpool.lock);
+	kst.budget = WSETBUDGET;
+	kst.used = wsetpool.used;
+	wsetacctadd(&total, &wsetpool.retired);
+	release(&wsetpool.lock);
+	wsetacctreport(&total, &kst.count);
+	memmove(st, &kst, sizeof(kst));
+	memmove(procs, kprocs, n * sizeof(*kprocs));
+	kfree((char *)kprocs);
+	return n;
 }
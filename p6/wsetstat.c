@@ -0,0 +1,63 @@
+// Print working set and page encryption statistics, once or
+// every interval ticks.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "ptentry.h"
+
+struct wsetinfo procs[NPROC];
+
+// Print n/d with one decimal.
+static void
+ratio(uint n, uint d)
+{
+  uint r;
+
+  r = d ? n * 10 / d : 0;
+  printf(1, "%d.%d", r / 10, r % 10);
+}
+
+static void
+printcount(struct wsetcount *c)
+{
+  printf(1, "%d %d %d %d %d ", c->faults, c->decrypts, c->evictions,
+         c->refclears, c->inserts);
+  ratio(c->sweeps, c->inserts);
+  printf(1, " %d %d %d\n", c->kcdecrypt, c->kcencrypt, c->kcinsert);
+}
+
+int
+main(int argc, char **argv)
+{
+  struct wsetstat st;
+  int i, n, interval, rounds;
+
+  interval = 0;
+  rounds = 1;
+  if(argc > 1){
+    interval = atoi(argv[1]);
+    rounds = argc > 2 ? atoi(argv[2]) : -1;
+  }
+
+  for(;;){
+    if((n = getwsetstat(&st, procs, NPROC)) < 0){
+      printf(2, "wsetstat: getwsetstat failed\n");
+      exit();
+    }
+    printf(1, "budget %d used %d\n", st.budget, st.used);
+    printf(1, "pid size res auto rate faults decrypts evicts refclr inserts sweep/ins kc-dec kc-enc kc-ins\n");
+    for(i = 0; i < n; i++){
+      printf(1, "%d %d %d %d %d ", procs[i].pid, procs[i].size,
+             procs[i].resident, procs[i].adaptive, procs[i].faultrate);
+      printcount(&procs[i].count);
+    }
+    printf(1, "all - - - - ");
+    printcount(&st.count);
+    if(--rounds == 0)
+      break;
+    sleep(interval);
+  }
+  exit();
+}